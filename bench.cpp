@@ -0,0 +1,1189 @@
+// ===== bench.cpp =====
+// Micro-benchmarks for MiniGit internals.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o bench bench.cpp -lz
+// Usage: ./bench sha1 [megabytes]
+//        ./bench objects [max-objects]
+//        ./bench compression <corpus-dir>
+//        ./bench diff [lines]
+//        ./bench commits [files]
+//        ./bench repo [small|medium|large|all] [--files N] [--size BYTES] [--depth N]
+//                     [--branches N] [--edit-rate FRACTION] [--json FILE]
+//        ./bench memory-add [megabytes]
+//        ./bench memory-diff [files]
+//        ./bench writers [processes] [rounds]
+//        ./bench paths
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <mutex>
+#include <stdexcept>
+#include <functional>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "sha1.h"
+#include "objectstore.h"
+#include "diff.h"
+#include "commitfile.h"
+#include "repository.h"
+
+using namespace std;
+namespace fs = filesystem;
+
+// ---------------------
+// Helpers
+// ---------------------
+template <typename Fn>
+double bestSeconds(int runs, Fn&& fn) {
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i) {
+        auto start = chrono::steady_clock::now();
+        fn();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+string randomBytes(size_t size, uint32_t seed) {
+    mt19937 rng(seed);
+    string data(size, '\0');
+    for (auto& c : data) c = static_cast<char>(rng());
+    return data;
+}
+
+void report(const string& name, size_t bytes, double seconds) {
+    cout << left << setw(28) << name << right << fixed << setprecision(2)
+         << setw(8) << (bytes / seconds / 1e9) << " GB/s\n";
+}
+
+// ---------------------
+// SHA-1 kernels
+// ---------------------
+int benchSha1(size_t megabytes) {
+    const size_t size = megabytes << 20;
+    string data = randomBytes(size, 1);
+
+    // Every kernel must agree before its timing means anything
+    string expected;
+    {
+        SHA1 sha(SHA1::Kernel::Portable);
+        sha.update(data);
+        expected = sha.final();
+    }
+
+    cout << "SHA-1 over " << megabytes << " MiB\n";
+    for (auto kernel : {SHA1::Kernel::Portable, SHA1::Kernel::ShaNi}) {
+        if (!SHA1::kernelSupported(kernel)) {
+            cout << left << setw(28) << SHA1::kernelName(kernel) << "unsupported on this CPU\n";
+            continue;
+        }
+        string got;
+        double secs = bestSeconds(3, [&] {
+            SHA1 sha(kernel);
+            sha.update(data);
+            got = sha.final();
+        });
+        if (got != expected) {
+            cerr << "Kernel " << SHA1::kernelName(kernel) << " produced a wrong digest\n";
+            return 1;
+        }
+        report(SHA1::kernelName(kernel), size, secs);
+    }
+
+    // Multi-buffer: many small independent inputs, as `add` sees for a
+    // source tree
+    const size_t pieceSize = 4096;
+    vector<string_view> pieces;
+    for (size_t off = 0; off + pieceSize <= size; off += pieceSize)
+        pieces.emplace_back(data.data() + off, pieceSize);
+    size_t multiBytes = pieces.size() * pieceSize;
+
+    vector<string> reference;
+    for (auto piece : pieces) {
+        SHA1 sha(SHA1::Kernel::Portable);
+        sha.update(piece);
+        reference.push_back(sha.final());
+    }
+
+    for (bool allowShaNi : {false, true}) {
+        if (allowShaNi && !SHA1::kernelSupported(SHA1::Kernel::ShaNi)) continue;
+        vector<string> got;
+        double secs = bestSeconds(3, [&] { got = sha1Multi(pieces, allowShaNi); });
+        if (got != reference) {
+            cerr << "Multi-buffer hashing produced a wrong digest\n";
+            return 1;
+        }
+        report(allowShaNi ? "multi-buffer (sha-ni)" : "multi-buffer (4 lanes)", multiBytes, secs);
+    }
+    return 0;
+}
+
+// ---------------------
+// Object store layouts
+// ---------------------
+// Grows a flat store and a fan-out store side by side through 10k, 100k,
+// 1M and 10M objects (up to maxObjects), timing inserts for each step and
+// lookups of present and absent hashes at each checkpoint.
+int benchObjects(size_t maxObjects) {
+    fs::path root = fs::temp_directory_path() / ("minigit-bench-" + to_string(getpid()));
+    fs::create_directories(root / "flat");
+    fs::create_directories(root / "fanout");
+    ObjectStore fanout((root / "fanout").string());
+    fanout.initialize();
+    string flatDir = (root / "flat").string();
+
+    auto flatInsert = [&](const string& content) {
+        string hash = sha1(content);
+        string path = flatDir + "/" + hash;
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0) return;
+        string temp = flatDir + "/tmp";
+        ofstream out(temp, ios::binary);
+        out << content;
+        out.close();
+        fs::rename(temp, path);
+    };
+    auto flatContains = [&](const string& hash) {
+        struct stat st;
+        return ::stat((flatDir + "/" + hash).c_str(), &st) == 0;
+    };
+
+    mt19937_64 rng(7);
+    const size_t probes = 10000;
+    size_t inserted = 0;
+
+    cout << left << setw(10) << "objects" << setw(8) << "layout"
+         << right << setw(14) << "insert us" << setw(14) << "hit us" << setw(14) << "miss us" << "\n";
+
+    for (size_t scale = 10000; scale <= maxObjects; scale *= 10) {
+        size_t from = inserted;
+        double flatSecs = bestSeconds(1, [&] { for (size_t i = from; i < scale; ++i) flatInsert("blob " + to_string(i)); });
+        double fanSecs = bestSeconds(1, [&] { for (size_t i = from; i < scale; ++i) fanout.store("blob " + to_string(i)); });
+        inserted = scale;
+
+        vector<string> hits, misses;
+        for (size_t i = 0; i < probes; ++i) {
+            hits.push_back(sha1("blob " + to_string(rng() % scale)));
+            misses.push_back(sha1("missing " + to_string(rng())));
+        }
+
+        size_t found = 0;
+        double flatHit = bestSeconds(3, [&] { for (auto& h : hits) found += flatContains(h); });
+        double flatMiss = bestSeconds(3, [&] { for (auto& h : misses) found += flatContains(h); });
+        double fanHit = bestSeconds(3, [&] { for (auto& h : hits) found += fanout.contains(h); });
+        double fanMiss = bestSeconds(3, [&] { for (auto& h : misses) found += fanout.contains(h); });
+
+        size_t added = scale - from;
+        auto row = [&](const char* layout, double insertSecs, double hit, double miss) {
+            cout << left << setw(10) << scale << setw(8) << layout << right << fixed << setprecision(2)
+                 << setw(14) << insertSecs / added * 1e6
+                 << setw(14) << hit / probes * 1e6
+                 << setw(14) << miss / probes * 1e6 << "\n";
+        };
+        row("flat", flatSecs, flatHit, flatMiss);
+        row("fan-out", fanSecs, fanHit, fanMiss);
+        if (found == 0) cout << "(no lookups hit)\n";
+    }
+
+    error_code ec;
+    fs::remove_all(root, ec);
+    return 0;
+}
+
+// ---------------------
+// Loose object compression
+// ---------------------
+// Stores every file under corpusDir at several zlib levels and reports the
+// on-disk size of the store and write/read throughput against plain objects.
+int benchCompression(const string& corpusDir) {
+    vector<string> files;
+    uintmax_t corpusBytes = 0;
+    error_code ec;
+    for (auto it = fs::recursive_directory_iterator(corpusDir, ec); it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) break;
+        if (it->is_regular_file(ec)) {
+            files.push_back(it->path().string());
+            corpusBytes += it->file_size(ec);
+        }
+    }
+    if (files.empty()) {
+        cout << "No files found under " << corpusDir << "\n";
+        return 1;
+    }
+
+    cout << files.size() << " files, " << corpusBytes / 1e6 << " MB\n";
+    cout << left << setw(10) << "level" << right << setw(14) << "store MB" << setw(10) << "ratio"
+         << setw(14) << "write MB/s" << setw(14) << "read MB/s" << "\n";
+
+    fs::path root = fs::temp_directory_path() / ("minigit-bench-" + to_string(getpid()));
+    for (int level : {0, 1, 6}) {
+        fs::remove_all(root, ec);
+        ObjectStore store(root.string());
+        store.initialize();
+        store.setCompressionLevel(level);
+
+        vector<string> hashes(files.size());
+        double writeSecs = bestSeconds(1, [&] {
+            for (size_t i = 0; i < files.size(); ++i) hashes[i] = store.storeFile(files[i]);
+        });
+
+        uintmax_t storeBytes = 0;
+        for (auto it = fs::recursive_directory_iterator(root, ec); it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_regular_file(ec)) storeBytes += it->file_size(ec);
+        }
+
+        size_t readBytes = 0;
+        vector<char> buf(ObjectStore::CHUNK_SIZE);
+        double readSecs = bestSeconds(3, [&] {
+            readBytes = 0;
+            for (const auto& hash : hashes) {
+                auto in = store.open(hash);
+                while (in->read(buf.data(), buf.size()) || in->gcount() > 0) readBytes += in->gcount();
+            }
+        });
+
+        cout << left << setw(10) << (level == 0 ? "plain" : to_string(level)) << right << fixed << setprecision(2)
+             << setw(14) << storeBytes / 1e6
+             << setw(10) << double(storeBytes) / corpusBytes
+             << setw(14) << corpusBytes / writeSecs / 1e6
+             << setw(14) << readBytes / readSecs / 1e6 << "\n";
+    }
+
+    fs::remove_all(root, ec);
+    return 0;
+}
+
+// ---------------------
+// Line diff
+// ---------------------
+// Diffs a synthetic source file against edited copies: a handful of
+// scattered edits (the common case) and one edit every few lines (the
+// worst case for an O(ND) algorithm). Times interning separately from the
+// diff itself and checks that both algorithms keep every common line.
+int benchDiff(size_t lineCount) {
+    mt19937 rng(3);
+    vector<string> base;
+    for (size_t i = 0; i < lineCount; ++i) {
+        // A few very common lines, like braces and blank lines in real code
+        if (rng() % 8 == 0) base.push_back(rng() % 2 ? "}" : "");
+        else base.push_back("    value_" + to_string(rng() % (lineCount * 4)) + " = compute(" + to_string(i) + ");");
+    }
+
+    auto edited = [&](size_t edits) {
+        vector<string> lines = base;
+        for (size_t e = 0; e < edits && !lines.empty(); ++e) {
+            size_t at = rng() % lines.size();
+            switch (rng() % 3) {
+            case 0: lines.erase(lines.begin() + at); break;
+            case 1: lines.insert(lines.begin() + at, "    inserted(" + to_string(e) + ");"); break;
+            default: lines[at] = "    changed(" + to_string(e) + ");"; break;
+            }
+        }
+        return lines;
+    };
+
+    cout << lineCount << " lines\n";
+    cout << left << setw(12) << "edits" << setw(12) << "algorithm" << right
+         << setw(12) << "intern ms" << setw(12) << "diff ms" << setw(12) << "changed" << "\n";
+
+    for (size_t edits : {size_t(10), lineCount / 5}) {
+        vector<string> target = edited(edits);
+
+        LineInterner interner;
+        vector<uint32_t> a, b;
+        double internSecs = bestSeconds(1, [&] {
+            a = interner.internAll(base);
+            b = interner.internAll(target);
+        });
+
+        for (auto algorithm : {DiffAlgorithm::Myers, DiffAlgorithm::Histogram}) {
+            DiffResult result;
+            double diffSecs = bestSeconds(3, [&] { result = diffLines(a, b, algorithm); });
+
+            size_t kept = 0, changed = 0;
+            for (char d : result.deleted) { kept += !d; changed += d; }
+            for (char i : result.inserted) changed += i;
+            vector<uint32_t> commonA, commonB;
+            for (size_t i = 0; i < a.size(); ++i) if (!result.deleted[i]) commonA.push_back(a[i]);
+            for (size_t j = 0; j < b.size(); ++j) if (!result.inserted[j]) commonB.push_back(b[j]);
+            if (commonA != commonB) {
+                cerr << "Diff produced inconsistent common lines\n";
+                return 1;
+            }
+
+            cout << left << setw(12) << edits << setw(12)
+                 << (algorithm == DiffAlgorithm::Myers ? "myers" : "histogram") << right << fixed << setprecision(2)
+                 << setw(12) << internSecs * 1e3 << setw(12) << diffSecs * 1e3 << setw(12) << changed << "\n";
+        }
+    }
+    return 0;
+}
+
+// ---------------------
+// Commit file parsing
+// ---------------------
+// Parses one flat-format commit listing `fileCount` files, first the way
+// the commands used to (getline plus an istringstream per line into a
+// map) and then with the mapped string_view parser.
+int benchCommits(size_t fileCount) {
+    fs::path path = fs::temp_directory_path() / ("minigit-bench-commit-" + to_string(getpid()) + ".txt");
+    {
+        ofstream out(path);
+        out << "Commit: " << sha1("commit") << "\nParent: null\nDate: Thu Jan  1 00:00:00 2026\n"
+            << "Message: bench\nFiles:\n";
+        // Commits list their files in path order, as the index keeps them
+        map<string, string> files;
+        for (size_t i = 0; i < fileCount; ++i)
+            files["src/module" + to_string(i % 100) + "/file" + to_string(i) + ".cpp"] = sha1(to_string(i));
+        for (const auto& [filename, blob] : files) out << filename << " " << blob << "\n";
+    }
+    size_t bytes = fs::file_size(path);
+
+    size_t streamCount = 0;
+    double streamSecs = bestSeconds(5, [&] {
+        map<string, string> files;
+        ifstream commitFile(path);
+        string line;
+        bool inFiles = false;
+        while (getline(commitFile, line)) {
+            if (line == "Files:") {
+                inFiles = true;
+                continue;
+            }
+            if (inFiles && !line.empty()) {
+                istringstream ss(line);
+                string filename, blob;
+                ss >> filename >> blob;
+                files[filename] = blob;
+            }
+        }
+        streamCount = files.size();
+    });
+
+    size_t mappedCount = 0;
+    double mappedSecs = bestSeconds(5, [&] {
+        CommitFile commit;
+        commit.open(path.string());
+        mappedCount = commit.files().size();
+    });
+
+    error_code ec;
+    fs::remove(path, ec);
+    if (streamCount != fileCount || mappedCount != fileCount) {
+        cerr << "Parsers disagree on the file count\n";
+        return 1;
+    }
+
+    cout << fileCount << " files, " << bytes / 1e6 << " MB commit\n";
+    cout << left << setw(28) << "getline + istringstream" << right << fixed << setprecision(2)
+         << setw(10) << streamSecs * 1e3 << " ms\n";
+    cout << left << setw(28) << "mmap + string_view" << right << fixed << setprecision(2)
+         << setw(10) << mappedSecs * 1e3 << " ms\n";
+    return 0;
+}
+
+// ---------------------
+// Synthetic repositories
+// ---------------------
+// Generates a repository of a given shape with the Repository API, timing
+// each operation the way one CLI invocation would run it: a fresh
+// Repository and no parsed trees cached in memory.
+struct RepoShape {
+    string name;
+    size_t files = 0;
+    size_t fileBytes = 0;     // approximate size of each text file
+    size_t depth = 0;         // commits on main after the initial one
+    size_t branches = 0;      // side branches, forked halfway up main
+    double editRate = 0;      // fraction of files edited per commit
+};
+
+struct RepoTiming {
+    string command;
+    double seconds;
+    size_t runs;
+};
+
+class RepoGenerator {
+public:
+    RepoGenerator(const RepoShape& shape, const fs::path& dir) : shape(shape), dir(dir), rng(42) {
+        contents.resize(shape.files);
+        for (size_t i = 0; i < shape.files; ++i) {
+            size_t lines = max<size_t>(1, shape.fileBytes / 48);
+            for (size_t j = 0; j < lines; ++j) contents[i].push_back(randomLine());
+        }
+    }
+
+    string pathOf(size_t file) const {
+        char name[64];
+        snprintf(name, sizeof(name), "dir%03zu/sub%02zu/file%06zu.txt", file / 1000, file / 100 % 10, file);
+        return name;
+    }
+
+    void writeAll() {
+        for (size_t i = 0; i < shape.files; ++i) writeFile(i);
+    }
+
+    // Rewrites a line in editRate of the files, returning their paths
+    vector<string> edit() {
+        size_t count = max<size_t>(1, static_cast<size_t>(shape.files * shape.editRate));
+        set<size_t> picked;
+        while (picked.size() < count) picked.insert(rng() % shape.files);
+
+        vector<string> paths;
+        for (size_t file : picked) {
+            auto& lines = contents[file];
+            lines[rng() % lines.size()] = randomLine();
+            writeFile(file);
+            paths.push_back(pathOf(file));
+        }
+        return paths;
+    }
+
+    // The working tree model, saved around side-branch work and restored
+    // once checkout has put main's files back
+    vector<vector<string>> snapshot() const { return contents; }
+    void restore(vector<vector<string>> saved) { contents = move(saved); }
+
+private:
+    RepoShape shape;
+    fs::path dir;
+    mt19937 rng;
+    vector<vector<string>> contents;
+
+    string randomLine() {
+        static const char* words[] = {"alpha", "beta", "gamma", "delta", "omega", "value", "index", "return",
+                                      "const", "string", "vector", "size_t", "commit", "branch", "merge", "tree"};
+        string line;
+        while (line.size() < 40) line += string(words[rng() % 16]) + " ";
+        line += to_string(rng() % 100000);
+        return line;
+    }
+
+    void writeFile(size_t file) {
+        fs::path path = dir / pathOf(file);
+        fs::create_directories(path.parent_path());
+        ofstream out(path, ios::binary);
+        for (const auto& line : contents[file]) out << line << "\n";
+    }
+};
+
+// Clears state a new process wouldn't have
+void coldStart() {
+    tree::ParsedTreeCache& cache = tree::ParsedTreeCache::instance();
+    lock_guard<mutex> lock(cache.mutex);
+    cache.trees.clear();
+}
+
+template <typename Fn>
+double timeOnce(Fn&& fn) {
+    coldStart();
+    auto start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+vector<RepoTiming> benchRepoShape(const RepoShape& shape) {
+    fs::path dir = fs::temp_directory_path() / ("minigit-bench-repo-" + to_string(getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    vector<RepoTiming> timings;
+    auto record = [&](const string& command, double seconds, size_t runs = 1) {
+        timings.push_back({command, seconds, runs});
+        cout << left << setw(10) << shape.name << setw(24) << command << right << fixed << setprecision(3)
+             << setw(12) << seconds * 1e3 << " ms\n" << flush;
+    };
+    auto check = [&](const OpResult& result, const string& what) {
+        if (!result.ok) throw runtime_error(what + ": " + result.error);
+    };
+
+    RepoGenerator generator(shape, dir);
+    generator.writeAll();
+    string workTree = dir.string();
+    Repository(workTree).init();
+
+    record("add (all files)", timeOnce([&] { check(Repository(workTree).add({"."}), "add"); }));
+    string firstCommit;
+    record("commit (initial)", timeOnce([&] {
+        CommitResult result = Repository(workTree).commit("initial");
+        check(result, "commit");
+        firstCommit = result.hash;
+    }));
+
+    // History: main grows to `depth` commits, with side branches forked
+    // halfway up, each carrying a few commits of its own
+    double addSecs = 0, commitSecs = 0;
+    size_t commits = 0;
+    auto commitEdit = [&](const string& message) {
+        vector<string> paths = generator.edit();
+        addSecs += timeOnce([&] { check(Repository(workTree).add(paths), "add"); });
+        commitSecs += timeOnce([&] { check(Repository(workTree).commit(message), "commit"); });
+        ++commits;
+    };
+    for (size_t i = 0; i < shape.depth; ++i) {
+        if (i == shape.depth / 2) {
+            auto mainFiles = generator.snapshot();
+            for (size_t b = 0; b < shape.branches; ++b) {
+                string branch = "side" + to_string(b);
+                Repository repo(workTree);
+                check(repo.createBranch(branch), "branch");
+                check(repo.checkout(branch), "checkout");
+                for (size_t c = 0; c < max<size_t>(1, shape.depth / 10); ++c) commitEdit(branch + " " + to_string(c));
+                check(Repository(workTree).checkout("main"), "checkout");
+                generator.restore(mainFiles);
+            }
+        }
+        commitEdit("main " + to_string(i));
+    }
+    if (commits > 0) {
+        record("add (edited files)", addSecs / commits, commits);
+        record("commit", commitSecs / commits, commits);
+    }
+
+    string head = Repository(workTree).resolveHead();
+    record("status", timeOnce([&] { check(Repository(workTree).status(), "status"); }));
+    record("add (all, unchanged)", timeOnce([&] { check(Repository(workTree).add({"."}), "add"); }));
+
+    size_t logged = 0;
+    record("log", timeOnce([&] {
+        check(Repository(workTree).log("", [&](const CommitInfo&) { ++logged; return true; }), "log");
+    }));
+    record("log -- <file>", timeOnce([&] {
+        check(Repository(workTree).log(generator.pathOf(0), [](const CommitInfo&) { return true; }), "log");
+    }));
+    record("diff (first..head)", timeOnce([&] { check(Repository(workTree).diff(firstCommit, head), "diff"); }));
+    record("checkout (first)", timeOnce([&] { check(Repository(workTree).checkout(firstCommit), "checkout"); }));
+    record("checkout (main)", timeOnce([&] { check(Repository(workTree).checkout("main"), "checkout"); }));
+    if (shape.branches > 0) {
+        record("merge (side0)", timeOnce([&] { check(Repository(workTree).merge("side0"), "merge"); }));
+    }
+
+    fs::remove_all(dir);
+    if (logged != shape.depth + 1) throw runtime_error("log listed " + to_string(logged) + " commits");
+    return timings;
+}
+
+string jsonString(const string& text) {
+    string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Runs every requested shape and writes the timings as JSON, one object
+// per (shape, command), so runs from two builds can be compared line by
+// line
+int benchRepo(const vector<RepoShape>& shapes, const string& jsonPath) {
+    cout << left << setw(10) << "scale" << setw(24) << "command" << right << setw(15) << "time" << "\n";
+    ostringstream json;
+    json << "{\n  \"suite\": \"repo\",\n  \"results\": [";
+    bool first = true;
+    for (const auto& shape : shapes) {
+        vector<RepoTiming> timings;
+        try {
+            timings = benchRepoShape(shape);
+        } catch (const exception& e) {
+            cerr << shape.name << ": " << e.what() << "\n";
+            return 1;
+        }
+        for (const auto& timing : timings) {
+            json << (first ? "\n" : ",\n") << "    {\"scale\": " << jsonString(shape.name) << ", \"files\": " << shape.files
+                 << ", \"fileBytes\": " << shape.fileBytes << ", \"depth\": " << shape.depth
+                 << ", \"branches\": " << shape.branches << ", \"editRate\": " << shape.editRate
+                 << ", \"command\": " << jsonString(timing.command) << ", \"runs\": " << timing.runs
+                 << ", \"seconds\": " << setprecision(6) << fixed << timing.seconds << defaultfloat << "}";
+            first = false;
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (!jsonPath.empty()) {
+        ofstream out(jsonPath);
+        out << json.str();
+        if (!out) {
+            cerr << "Could not write " << jsonPath << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------
+// Child processes
+// ---------------------
+// The checks below run their work in forked children: peak RSS is then
+// the child's own (from wait4), limits don't leak into the parent, and
+// concurrent children are real concurrent processes. A child reports back
+// through a pipe and its exit status.
+struct Child {
+    pid_t pid = -1;
+    int output = -1;
+};
+
+struct ChildResult {
+    int status = -1;          // exit status, or -1 if the child didn't exit
+    long peakKb = 0;          // ru_maxrss
+    string output;
+};
+
+Child spawnChild(const function<int(ostream&)>& fn) {
+    int fds[2];
+    if (pipe(fds) != 0) throw runtime_error("pipe failed");
+    cout << flush;
+    pid_t pid = fork();
+    if (pid < 0) throw runtime_error("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        ostringstream out;
+        int status = 1;
+        try {
+            status = fn(out);
+        } catch (const exception& e) {
+            out << e.what() << "\n";
+        }
+        string text = out.str();
+        for (size_t at = 0; at < text.size();) {
+            ssize_t n = write(fds[1], text.data() + at, text.size() - at);
+            if (n <= 0) break;
+            at += n;
+        }
+        _exit(status);
+    }
+    close(fds[1]);
+    return {pid, fds[0]};
+}
+
+ChildResult finishChild(const Child& child) {
+    ChildResult result;
+    char buffer[4096];
+    for (ssize_t n; (n = read(child.output, buffer, sizeof(buffer))) > 0;) result.output.append(buffer, n);
+    close(child.output);
+
+    int status = 0;
+    struct rusage usage {};
+    wait4(child.pid, &status, 0, &usage);
+    result.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    result.peakKb = usage.ru_maxrss;
+    return result;
+}
+
+ChildResult runChild(const function<int(ostream&)>& fn) { return finishChild(spawnChild(fn)); }
+
+fs::path scratchRepo(const string& name) {
+    fs::path dir = fs::temp_directory_path() / ("minigit-bench-" + name + "-" + to_string(getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir;
+}
+
+// ---------------------
+// Streaming add memory
+// ---------------------
+// Stages a `megabytes` file in a child whose address space is capped at
+// what it already uses plus ADD_HEADROOM, far less than the file: once
+// with add, which chunks a file this large, and once into a plain store
+// that writes it as one streamed object. Both must succeed without
+// buffering the file, agree on its hash, and read it back intact.
+constexpr size_t ADD_HEADROOM = 64 << 20;
+
+size_t virtualBytes() {
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    statm >> pages;
+    return pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+int benchMemoryAdd(size_t megabytes) {
+    fs::path dir = scratchRepo("memory-add");
+    string workTree = dir.string();
+    {
+        // Compressible text, so the objects don't take as much disk again
+        ofstream out(dir / "big.txt", ios::binary);
+        mt19937 rng(11);
+        string block;
+        while (out.tellp() < static_cast<streamoff>(megabytes << 20)) {
+            block.clear();
+            while (block.size() < (1 << 20)) block += "line " + to_string(rng() % 1000000) + " of the large file\n";
+            out << block;
+        }
+        ofstream(dir / "small.txt") << "small\n";
+    }
+    size_t fileBytes = fs::file_size(dir / "big.txt");
+
+    ChildResult staged = runChild([&](ostream& out) {
+        Repository repo(workTree);
+        if (!repo.init().ok || !repo.add({"small.txt"}).ok) return 1;  // starts the worker pool
+
+        size_t limit = virtualBytes() + ADD_HEADROOM;
+        struct rlimit cap {limit, limit};
+        if (setrlimit(RLIMIT_AS, &cap) != 0) {
+            out << "setrlimit failed\n";
+            return 1;
+        }
+        AddResult added = repo.add({"big.txt"});
+        if (!added.ok || !added.failed.empty() || added.added.size() != 1) {
+            out << "add failed under the limit: " << added.error << "\n";
+            return 1;
+        }
+        StagingIndex index = repo.index();
+        const IndexEntry* entry = index.find("big.txt");
+        ObjectStore plain((dir / "plain-objects").string());
+        plain.initialize();
+        plain.setChunkThreshold(UINT64_MAX);
+        string plainHash = plain.storeFile((dir / "big.txt").string());
+        out << (entry ? entry->hash : "") << " " << plainHash << " " << limit;
+        return 0;
+    });
+
+    string hash, plainHash;
+    size_t limit = 0;
+    istringstream(staged.output) >> hash >> plainHash >> limit;
+    cout << fileBytes / (1 << 20) << " MiB file, address space capped at " << limit / (1 << 20) << " MiB\n";
+    cout << "peak RSS while staging: " << staged.peakKb / 1024 << " MiB\n";
+    if (staged.status != 0 || hash.empty() || hash != plainHash) {
+        cerr << "Staging under the limit failed: " << staged.output << "\n";
+        fs::remove_all(dir);
+        return 1;
+    }
+
+    // Read both copies back, a block at a time, against the file
+    ChildResult verified = runChild([&](ostream& out) {
+        ObjectStore chunked((dir / ".minigit" / "objects").string());
+        ObjectStore plain((dir / "plain-objects").string());
+        for (const ObjectStore* store : {&chunked, &plain}) {
+            auto blob = store->open(hash);
+            ifstream file(dir / "big.txt", ios::binary);
+            vector<char> a(1 << 20), b(1 << 20);
+            while (blob && file) {
+                blob->read(a.data(), a.size());
+                file.read(b.data(), b.size());
+                if (blob->gcount() != file.gcount() || !equal(a.begin(), a.begin() + file.gcount(), b.begin())) {
+                    out << "stored blob differs from the file\n";
+                    return 1;
+                }
+            }
+            if (!blob) {
+                out << "stored blob is missing\n";
+                return 1;
+            }
+        }
+        return 0;
+    });
+    fs::remove_all(dir);
+    if (verified.status != 0) {
+        cerr << verified.output;
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------
+// Streaming diff memory
+// ---------------------
+// Diffs two commits that rewrite every line of `fileCount` files with an
+// onFile callback, and fails unless the diff's peak RSS stays well below
+// the total patch size: streamed patches must be released as they go, not
+// held until the whole diff is done.
+int benchMemoryDiff(size_t fileCount) {
+    fs::path dir = scratchRepo("memory-diff");
+    string workTree = dir.string();
+    ChildResult setup = runChild([&](ostream& out) {
+        Repository repo(workTree);
+        repo.init();
+        mt19937 rng(5);
+        for (int version = 0; version < 2; ++version) {
+            for (size_t i = 0; i < fileCount; ++i) {
+                fs::path path = dir / ("dir" + to_string(i / 100)) / ("file" + to_string(i) + ".txt");
+                fs::create_directories(path.parent_path());
+                ofstream file(path);
+                for (int line = 0; line < 400; ++line) file << "version " << version << " line " << rng() << " of " << i << "\n";
+            }
+            if (!repo.add({"."}).ok) return 1;
+            CommitResult commit = repo.commit("version " + to_string(version));
+            if (!commit.ok) return 1;
+            out << commit.hash << "\n";
+        }
+        return 0;
+    });
+    istringstream hashes(setup.output);
+    string first, second;
+    hashes >> first >> second;
+    if (setup.status != 0 || second.empty()) {
+        cerr << "Setup failed: " << setup.output;
+        fs::remove_all(dir);
+        return 1;
+    }
+
+    // Same process shape with nothing to diff, for the baseline RSS
+    auto streamDiff = [&](const string& to) {
+        return runChild([&, to](ostream& out) {
+            size_t files = 0, bytes = 0;
+            CommitDiffResult result = Repository(workTree).diff(first, to, DiffAlgorithm::Myers, [&](const FileDiff& file) {
+                ++files;
+                bytes += file.patch.size();
+            });
+            out << files << " " << bytes;
+            return result.ok ? 0 : 1;
+        });
+    };
+    ChildResult empty = streamDiff(first);
+    ChildResult full = streamDiff(second);
+    fs::remove_all(dir);
+
+    size_t files = 0, patchBytes = 0;
+    istringstream(full.output) >> files >> patchBytes;
+    long growthKb = full.peakKb - empty.peakKb;
+    cout << files << " files, " << patchBytes / (1 << 20) << " MiB of patches\n";
+    cout << "peak RSS: " << empty.peakKb / 1024 << " MiB without changes, " << full.peakKb / 1024
+         << " MiB streaming the diff\n";
+    if (empty.status != 0 || full.status != 0 || files != fileCount) {
+        cerr << "Diff failed: " << full.output << "\n";
+        return 1;
+    }
+    if (growthKb * 1024 > static_cast<long>(patchBytes / 4)) {
+        cerr << "Streaming diff grew by " << growthKb / 1024 << " MiB, more than a quarter of the patches\n";
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------
+// Concurrent writers
+// ---------------------
+// `writers` processes each add and commit a new file `rounds` times
+// against one repository, with a fresh Repository per operation like
+// separate CLI runs. At the end each one creates its own branch, and all
+// of them race to create one shared branch. Writer 0 also runs pack-refs
+// every round. The check fails if any update is lost: every commit a
+// writer was told succeeded must be in the history, every file must be
+// in the index and in HEAD's tree, exactly one writer must win the shared
+// branch, and no lock file may be left behind.
+int benchWriters(size_t writers, size_t rounds) {
+    fs::path dir = scratchRepo("writers");
+    string workTree = dir.string();
+    auto pathOf = [](size_t writer, size_t round) {
+        return "writer" + to_string(writer) + "/file" + to_string(round) + ".txt";
+    };
+
+    // Set up in a child too, so this process never starts the worker pool
+    // it would otherwise fork with
+    ChildResult setup = runChild([&](ostream& out) {
+        Repository repo(workTree);
+        ofstream(dir / "base.txt") << "base\n";
+        if (!repo.init().ok || !repo.add({"base.txt"}).ok) return 1;
+        CommitResult commit = repo.commit("base");
+        out << commit.error;
+        return commit.ok ? 0 : 1;
+    });
+    if (setup.status != 0) {
+        cerr << "Setup failed: " << setup.output << "\n";
+        fs::remove_all(dir);
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<Child> children;
+    for (size_t writer = 0; writer < writers; ++writer) {
+        children.push_back(spawnChild([&, writer](ostream& out) {
+            for (size_t round = 0; round < rounds; ++round) {
+                string path = pathOf(writer, round);
+                fs::create_directories((dir / path).parent_path());
+                ofstream(dir / path) << "writer " << writer << " round " << round << "\n";
+
+                AddResult added = Repository(workTree).add({path});
+                if (!added.ok || !added.failed.empty()) {
+                    out << "add " << path << ": " << added.error << "\n";
+                    return 1;
+                }
+                // A commit that finds its file already committed by another
+                // writer has nothing left to do
+                CommitResult commit = Repository(workTree).commit("writer " + to_string(writer) + " round " + to_string(round));
+                if (commit.ok) out << "commit " << commit.hash << "\n";
+                else if (commit.error.rfind("Nothing to commit", 0) != 0) {
+                    out << "commit: " << commit.error << "\n";
+                    return 1;
+                }
+                if (writer == 0) {
+                    PackRefsResult packed = Repository(workTree).packRefs();
+                    if (!packed.ok) {
+                        out << "pack-refs: " << packed.error << "\n";
+                        return 1;
+                    }
+                }
+            }
+            BranchResult own = Repository(workTree).createBranch("writer" + to_string(writer));
+            if (!own.ok) {
+                out << "branch: " << own.error << "\n";
+                return 1;
+            }
+            BranchResult shared = Repository(workTree).createBranch("shared");
+            if (shared.ok) out << "won\n";
+            else if (shared.error.find("already exists") == string::npos) {
+                out << "branch: " << shared.error << "\n";
+                return 1;
+            }
+            return 0;
+        }));
+    }
+
+    set<string> reported;
+    size_t winners = 0, failed = 0;
+    for (size_t writer = 0; writer < children.size(); ++writer) {
+        ChildResult result = finishChild(children[writer]);
+        istringstream lines(result.output);
+        for (string word, hash; lines >> word;) {
+            if (word == "commit" && lines >> hash) reported.insert(hash);
+            else if (word == "won") ++winners;
+        }
+        if (result.status != 0) {
+            cerr << "writer " << writer << " failed: " << result.output;
+            ++failed;
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    // Verify in a child as well; the results come back as problem lines
+    ChildResult verify = runChild([&](ostream& out) {
+        Repository repo(workTree);
+        set<string> logged;
+        repo.log("", [&](const CommitInfo& commit) {
+            logged.insert(commit.hash);
+            return true;
+        });
+        for (const auto& hash : reported) {
+            if (!logged.count(hash)) out << "commit " << hash << " is missing from the history\n";
+        }
+        if (logged.size() != reported.size() + 1) {
+            out << "history has " << logged.size() << " commits for " << reported.size() << " reported\n";
+        }
+
+        StagingIndex index = repo.index();
+        FileTable head = repo.commitFiles(repo.resolveHead());
+        set<string> committed;
+        for (const auto& [path, blob] : head) committed.insert(path);
+        for (size_t writer = 0; writer < writers; ++writer) {
+            for (size_t round = 0; round < rounds; ++round) {
+                string path = pathOf(writer, round);
+                if (!index.find(path)) out << path << " is missing from the index\n";
+                if (!committed.count(path)) out << path << " is missing from HEAD\n";
+            }
+        }
+
+        set<string> branches;
+        for (const auto& [name, commit] : repo.listBranches().branches) branches.insert(name);
+        for (size_t writer = 0; writer < writers; ++writer) {
+            if (!branches.count("writer" + to_string(writer))) out << "branch writer" << writer << " is missing\n";
+        }
+        if (!branches.count("shared")) out << "branch shared is missing\n";
+
+        for (const auto& entry : fs::recursive_directory_iterator(dir / ".minigit")) {
+            if (entry.path().extension() == ".lock") out << "lock left behind: " << entry.path().string() << "\n";
+        }
+        return 0;
+    });
+    fs::remove_all(dir);
+
+    size_t operations = writers * rounds * 2;
+    cout << writers << " writers x " << rounds << " rounds: " << reported.size() << " commits, "
+         << writers * rounds - reported.size() << " folded into another writer's commit\n";
+    cout << fixed << setprecision(2) << elapsed.count() << " s, " << operations / elapsed.count()
+         << " adds and commits per second\n";
+    if (winners != 1) cerr << winners << " writers created the shared branch\n";
+    if (!verify.output.empty() || verify.status != 0) cerr << verify.output;
+    return failed == 0 && winners == 1 && verify.output.empty() && verify.status == 0 ? 0 : 1;
+}
+
+// ---------------------
+// Paths outside the work tree
+// ---------------------
+// add must take an absolute path inside the work tree as the relative one
+// and refuse paths outside it, absolute or through "..". An index that
+// already holds such paths, as older builds wrote, must make commit fail
+// with an error rather than crash or leave index.lock behind, and adding
+// the path again must unstage it.
+int benchPaths() {
+    fs::path dir = scratchRepo("paths");
+    fs::path outside = dir.string() + "-outside.txt";
+    string workTree = dir.string();
+    ofstream(dir / "base.txt") << "base\n";
+    ofstream(dir / "abs.txt") << "absolute\n";
+    ofstream(outside) << "outside\n";
+
+    // Each step runs in a child, so a crash shows up as a failed status
+    ChildResult staged = runChild([&](ostream& out) {
+        Repository repo(workTree);
+        if (!repo.init().ok || !repo.add({"base.txt"}).ok || !repo.commit("base").ok) return 1;
+
+        AddResult inside = repo.add({(dir / "abs.txt").string()});
+        if (!inside.ok || !inside.outside.empty() || !repo.index().find("abs.txt")) {
+            out << "absolute path inside the work tree was not staged as abs.txt\n";
+        }
+        string escaped = "../" + outside.filename().string();
+        for (const string& path : {outside.string(), escaped}) {
+            AddResult refused = repo.add({path});
+            if (refused.outside != vector<string>{path} || !refused.added.empty()) {
+                out << "add " << path << " was not refused\n";
+            }
+        }
+        StagingIndex index = repo.index();
+        for (const auto& [path, entry] : index.all()) {
+            if (path != "base.txt" && path != "abs.txt") out << "index holds " << path << "\n";
+        }
+
+        // Plant the entries an older build would have written
+        string blob = index.find("base.txt")->hash;
+        OpResult planted = repo.updateIndex([&](StagingIndex& index) {
+            index.upsert({outside.string(), blob, {}});
+            index.upsert({escaped, blob, {}});
+            return true;
+        });
+        return planted.ok ? 0 : 1;
+    });
+
+    ChildResult refused = runChild([&](ostream& out) {
+        CommitResult commit = Repository(workTree).commit("invalid paths");
+        if (commit.ok) out << "commit with invalid index paths succeeded\n";
+        return 0;
+    });
+    bool locked = fs::exists(dir / ".minigit" / "index.lock");
+
+    ChildResult recovered = runChild([&](ostream& out) {
+        Repository repo(workTree);
+        AddResult unstaged = repo.add({outside.string(), "../" + outside.filename().string()});
+        if (unstaged.removed.size() != 2) out << "add did not unstage the invalid paths\n";
+        CommitResult commit = repo.commit("after cleanup");
+        if (!commit.ok) out << "commit after cleanup failed: " << commit.error << "\n";
+        return 0;
+    });
+    fs::remove_all(dir);
+    fs::remove(outside);
+
+    bool passed = true;
+    for (const auto& [step, result] : {pair<string, const ChildResult&>{"staging", staged}, {"commit", refused},
+                                       {"recovery", recovered}}) {
+        if (result.status == 0 && result.output.empty()) continue;
+        cerr << step << (result.status < 0 ? " crashed" : " failed") << ": " << result.output;
+        passed = false;
+    }
+    if (locked) {
+        cerr << "commit left .minigit/index.lock behind\n";
+        passed = false;
+    }
+    cout << (passed ? "paths outside the work tree refused, invalid index paths fail commit cleanly\n" : "");
+    return passed ? 0 : 1;
+}
+
+// ---------------------
+// Main Function
+// ---------------------
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "Usage: ./bench sha1 [megabytes]\n"
+             << "       ./bench objects [max-objects]\n"
+             << "       ./bench compression <corpus-dir>\n"
+             << "       ./bench diff [lines]\n"
+             << "       ./bench commits [files]\n"
+             << "       ./bench repo [small|medium|large|all] [--files N] [--size BYTES] [--depth N]\n"
+             << "                    [--branches N] [--edit-rate FRACTION] [--json FILE]\n"
+             << "       ./bench memory-add [megabytes]\n"
+             << "       ./bench memory-diff [files]\n"
+             << "       ./bench writers [processes] [rounds]\n"
+             << "       ./bench paths\n";
+        return 1;
+    }
+
+    string suite = argv[1];
+
+    if (suite == "sha1") {
+        size_t megabytes = argc >= 3 ? stoul(argv[2]) : 256;
+        return benchSha1(megabytes);
+    }
+
+    if (suite == "objects") {
+        size_t maxObjects = argc >= 3 ? stoul(argv[2]) : 1000000;
+        return benchObjects(maxObjects);
+    }
+
+    if (suite == "compression" && argc >= 3) {
+        return benchCompression(argv[2]);
+    }
+
+    if (suite == "diff") {
+        size_t lineCount = argc >= 3 ? stoul(argv[2]) : 200000;
+        return benchDiff(lineCount);
+    }
+
+    if (suite == "commits") {
+        size_t fileCount = argc >= 3 ? stoul(argv[2]) : 100000;
+        return benchCommits(fileCount);
+    }
+
+    if (suite == "repo") {
+        // Preset scales; "large" has enough history for per-commit costs
+        // in log and merge to dominate
+        map<string, RepoShape> presets = {
+            {"small", {"small", 200, 1024, 50, 2, 0.02}},
+            {"medium", {"medium", 2000, 2048, 300, 4, 0.01}},
+            {"large", {"large", 10000, 2048, 2000, 8, 0.002}},
+        };
+        vector<RepoShape> shapes;
+        RepoShape custom{"custom", 1000, 2048, 100, 2, 0.01};
+        bool customized = false;
+        string jsonPath;
+        for (int i = 2; i < argc; ++i) {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--json" && hasValue) jsonPath = argv[++i];
+            else if (arg == "--files" && hasValue) custom.files = stoul(argv[++i]), customized = true;
+            else if (arg == "--size" && hasValue) custom.fileBytes = stoul(argv[++i]), customized = true;
+            else if (arg == "--depth" && hasValue) custom.depth = stoul(argv[++i]), customized = true;
+            else if (arg == "--branches" && hasValue) custom.branches = stoul(argv[++i]), customized = true;
+            else if (arg == "--edit-rate" && hasValue) custom.editRate = stod(argv[++i]), customized = true;
+            else if (arg == "all") for (const auto& name : {"small", "medium", "large"}) shapes.push_back(presets[name]);
+            else if (presets.count(arg)) shapes.push_back(presets[arg]);
+            else {
+                cout << "Unknown option: " << arg << "\n";
+                return 1;
+            }
+        }
+        if (customized) shapes.push_back(custom);
+        if (shapes.empty()) shapes = {presets["small"], presets["medium"]};
+        return benchRepo(shapes, jsonPath);
+    }
+
+    if (suite == "memory-add") {
+        size_t megabytes = argc >= 3 ? stoul(argv[2]) : 256;
+        return benchMemoryAdd(megabytes);
+    }
+
+    if (suite == "memory-diff") {
+        size_t fileCount = argc >= 3 ? stoul(argv[2]) : 2000;
+        return benchMemoryDiff(fileCount);
+    }
+
+    if (suite == "writers") {
+        size_t writers = argc >= 3 ? stoul(argv[2]) : 8;
+        size_t rounds = argc >= 4 ? stoul(argv[3]) : 20;
+        return benchWriters(writers, rounds);
+    }
+
+    if (suite == "paths") {
+        return benchPaths();
+    }
+
+    cout << "Unknown benchmark: " << suite << "\n";
+    return 1;
+}
@@ -0,0 +1,169 @@
+// bloom.h
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sha1.h"
+#include "byteio.h"
+#include "mappedfile.h"
+
+// ---------------------
+// Changed-path Bloom filters
+// ---------------------
+// One filter per commit over the paths it changed relative to its parent,
+// plus every leading directory of those paths, so `log -- <path>` can skip
+// most commits without reading their trees. A filter never misses a path
+// that changed; it may claim a path changed when it didn't, so callers
+// confirm a "maybe" against the trees.
+//
+// Filters use 10 bits per path and 7 probes, derived by double hashing
+// from a 64-bit FNV-1a of the path, which is fixed so that files written
+// by one build read the same in any other.
+class ChangedPathFilter {
+public:
+    static constexpr uint32_t BITS_PER_PATH = 10;
+    static constexpr uint32_t PROBES = 7;
+    static constexpr size_t MAX_PATHS = 512;
+
+    ChangedPathFilter() = default;
+
+    // A commit changing more than MAX_PATHS paths gets an empty filter,
+    // which answers "maybe" for everything
+    explicit ChangedPathFilter(const std::vector<std::string> &changedPaths) {
+        std::vector<std::string_view> keys;
+        for (const auto &path : changedPaths) {
+            std::string_view key = path;
+            for (;;) {
+                keys.push_back(key);
+                size_t slash = key.rfind('/');
+                if (slash == std::string_view::npos) break;
+                key = key.substr(0, slash);
+            }
+        }
+        if (keys.size() > MAX_PATHS) return;
+
+        bits = std::max<uint32_t>(64, static_cast<uint32_t>(keys.size()) * BITS_PER_PATH);
+        bits = (bits + 7) / 8 * 8;
+        data.assign(bits / 8, 0);
+        for (auto key : keys) {
+            forEachProbe(key, bits, [&](uint32_t bit) { data[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8)); });
+        }
+    }
+
+    uint32_t bitCount() const { return bits; }
+    const std::vector<uint8_t> &bytes() const { return data; }
+
+    // False only if `path` certainly did not change
+    static bool mightContain(const uint8_t *filter, uint32_t bits, std::string_view path) {
+        if (bits == 0) return true;
+        bool all = true;
+        forEachProbe(path, bits, [&](uint32_t bit) { all = all && (filter[bit / 8] & (1u << (bit % 8))); });
+        return all;
+    }
+
+private:
+    uint32_t bits = 0;
+    std::vector<uint8_t> data;
+
+    template <typename Fn>
+    static void forEachProbe(std::string_view key, uint32_t bits, Fn fn) {
+        uint64_t h = 1469598103934665603ULL;
+        for (unsigned char c : key) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+        for (uint32_t i = 0; i < PROBES; ++i) fn((h1 + i * h2) % bits);
+    }
+};
+
+// Side file .minigit/commit-bloom holding every commit's filter, keyed by
+// commit hash. Little-endian:
+//
+//   "MGBF" | version u32
+//   per commit, in commit order:
+//     hash 20 bytes | bit count u32 (0: too many changes) | bit count / 8 bytes
+//
+// commitChanges appends one record per commit. Commits without a record,
+// such as those made by older builds, are simply never skipped.
+class BloomIndex {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 8;
+
+    // Returns false if the file is missing or malformed
+    bool load(const std::string &path) {
+        filters.clear();
+        if (!file.open(path)) return false;
+        if (file.size() < HEADER_SIZE || std::memcmp(file.data(), "MGBF", 4) != 0 ||
+            byteio::getU32(file.data() + 4) != VERSION) {
+            file = MappedFile();
+            return false;
+        }
+
+        size_t at = HEADER_SIZE;
+        while (at + 24 <= file.size()) {
+            uint32_t bits = byteio::getU32(file.data() + at + 20);
+            if (at + 24 + bits / 8 > file.size()) break;  // torn final append
+            std::string key(reinterpret_cast<const char*>(file.data() + at), 20);
+            filters[key] = {file.data() + at + 24, bits};
+            at += 24 + bits / 8;
+        }
+        return true;
+    }
+
+    // False only if the commit has a filter and `path` is certainly not in it
+    bool mightHaveChanged(const std::string &commitHash, std::string_view path) const {
+        auto it = filters.find(rawKey(commitHash));
+        if (it == filters.end()) return true;
+        return ChangedPathFilter::mightContain(it->second.bytes, it->second.bits, path);
+    }
+
+    bool has(const std::string &commitHash) const { return filters.count(rawKey(commitHash)) > 0; }
+
+    // Appends one commit's filter with a single O_APPEND write, adding the
+    // header first if the file is new. Callers hold the file's lock so only
+    // one writer can add the header.
+    static bool append(const std::string &path, const std::string &commitHash, const ChangedPathFilter &filter) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+
+        std::string bytes;
+        if (lseek(fd, 0, SEEK_END) == 0) {
+            bytes = "MGBF";
+            byteio::putU32(bytes, VERSION);
+        }
+        bytes += rawKey(commitHash);
+        byteio::putU32(bytes, filter.bitCount());
+        bytes.append(reinterpret_cast<const char*>(filter.bytes().data()), filter.bytes().size());
+
+        bool ok = ::write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size());
+        ::close(fd);
+        return ok;
+    }
+
+private:
+    struct Filter {
+        const uint8_t *bytes;
+        uint32_t bits;
+    };
+
+    MappedFile file;
+    std::unordered_map<std::string, Filter> filters;
+
+    static std::string rawKey(const std::string &commitHash) {
+        uint8_t raw[20];
+        rawFromHex(commitHash, raw);
+        return std::string(reinterpret_cast<const char*>(raw), 20);
+    }
+};
+
+#endif // BLOOM_H
@@ -0,0 +1,51 @@
+// byteio.h
+#ifndef BYTEIO_H
+#define BYTEIO_H
+
+#include <string>
+#include <cstdint>
+
+// Little-endian integer encoding shared by the binary repository files
+namespace byteio {
+
+inline void putU32(std::string &out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(v >> (i * 8)));
+}
+
+inline void putU64(std::string &out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>(v >> (i * 8)));
+}
+
+inline uint32_t getU32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(p[i]) << (i * 8);
+    return v;
+}
+
+inline uint64_t getU64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(p[i]) << (i * 8);
+    return v;
+}
+
+inline void putVarint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline bool getVarint(const std::string &in, size_t &pos, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(in[pos++]);
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+} // namespace byteio
+
+#endif // BYTEIO_H
@@ -0,0 +1,73 @@
+// chunker.h
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// ---------------------
+// Content-defined chunking
+// ---------------------
+// FastCDC: a Gear rolling hash, hash = (hash << 1) + gear[byte], depends
+// only on the last 64 bytes, and a boundary falls wherever its top bits are
+// all zero. Boundaries therefore follow the content rather than offsets: an
+// edit moves the boundaries next to it, and every chunk before and after
+// it comes out byte-identical to the previous version.
+//
+// Normalized chunking: a stricter mask below AVG_SIZE and a looser one
+// above it pull chunk sizes in towards the average, and nothing is cut
+// before MIN_SIZE or after MAX_SIZE.
+namespace cdc {
+
+constexpr size_t MIN_SIZE = 16 << 10;
+constexpr size_t AVG_SIZE = 64 << 10;
+constexpr size_t MAX_SIZE = 256 << 10;
+
+// log2(AVG_SIZE) + 2 and - 2 significant bits
+constexpr uint64_t MASK_SMALL = ~0ULL << (64 - 18);
+constexpr uint64_t MASK_LARGE = ~0ULL << (64 - 14);
+
+// A fixed pseudo-random word per byte value (splitmix64 from a constant
+// seed), so every build cuts the same content at the same places
+inline const std::array<uint64_t, 256> &gearTable() {
+    static const std::array<uint64_t, 256> table = [] {
+        std::array<uint64_t, 256> words{};
+        uint64_t state = 0x6d696e6967697421ULL;
+        for (auto &word : words) {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+        return words;
+    }();
+    return table;
+}
+
+// Length of the chunk that starts at `data`, given `len` bytes available.
+// The answer is only final if len >= MAX_SIZE or the input ends at len;
+// otherwise the caller should read more first.
+inline size_t cut(const uint8_t *data, size_t len) {
+    if (len <= MIN_SIZE) return len;
+    len = std::min(len, MAX_SIZE);
+    size_t normal = std::min(len, AVG_SIZE);
+    const auto &gear = gearTable();
+
+    uint64_t hash = 0;
+    size_t i = MIN_SIZE;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & MASK_SMALL)) return i + 1;
+    }
+    for (; i < len; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & MASK_LARGE)) return i + 1;
+    }
+    return len;
+}
+
+} // namespace cdc
+
+#endif // CHUNKER_H
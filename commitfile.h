@@ -0,0 +1,92 @@
+// commitfile.h
+#ifndef COMMITFILE_H
+#define COMMITFILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include "mappedfile.h"
+#include "trace.h"
+
+// ---------------------
+// Commit file parser
+// ---------------------
+// Memory-maps a commits/<hash>.txt file and parses it in place:
+//
+//   Commit: <hash>
+//   Parent: <hash or "null">
+//   Date: <ctime() output>
+//   Message: <text>
+//   Tree: <root tree hash>          commits with tree objects
+//   Files:                          older commits, one line per file:
+//   <path> <blob hash>
+//
+// Every field is a string_view into the mapping, so nothing is copied and
+// the views stay valid for as long as the CommitFile lives.
+struct CommitFileEntry {
+    std::string_view path;
+    std::string_view hash;
+};
+
+class CommitFile {
+public:
+    // Returns false if the commit file is missing
+    bool open(const std::string &path) {
+        trace::Span span("commitfile.parse");
+        entries.clear();
+        commitHash = parentHash = dateText = messageText = treeHash = {};
+        if (!file.open(path)) return false;
+
+        std::string_view rest = file.view();
+        bool inFiles = false;
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            std::string_view line = rest.substr(0, end);
+            rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+
+            if (inFiles) {
+                size_t space = line.rfind(' ');
+                if (space != std::string_view::npos) entries.push_back({line.substr(0, space), line.substr(space + 1)});
+            } else if (line == "Files:") {
+                inFiles = true;
+            } else {
+                header(line, "Commit: ", commitHash);
+                header(line, "Parent: ", parentHash);
+                header(line, "Date: ", dateText);
+                header(line, "Message: ", messageText);
+                header(line, "Tree: ", treeHash);
+            }
+        }
+
+        // One entry per path; a path listed twice keeps its last line, as
+        // the map older builds parsed into did
+        auto byPath = [](const CommitFileEntry &a, const CommitFileEntry &b) { return a.path < b.path; };
+        auto samePath = [](const CommitFileEntry &a, const CommitFileEntry &b) { return a.path == b.path; };
+        if (!std::is_sorted(entries.begin(), entries.end(), byPath)) {
+            std::stable_sort(entries.begin(), entries.end(), byPath);
+        }
+        entries.erase(entries.begin(), std::unique(entries.rbegin(), entries.rend(), samePath).base());
+        return true;
+    }
+
+    std::string_view commit() const { return commitHash; }
+    std::string_view parent() const { return parentHash; }
+    std::string_view date() const { return dateText; }
+    std::string_view message() const { return messageText; }
+    std::string_view tree() const { return treeHash; }
+
+    // Files of an old-format commit, sorted by path; empty for tree commits
+    const std::vector<CommitFileEntry> &files() const { return entries; }
+
+private:
+    MappedFile file;
+    std::string_view commitHash, parentHash, dateText, messageText, treeHash;
+    std::vector<CommitFileEntry> entries;
+
+    static void header(std::string_view line, std::string_view key, std::string_view &value) {
+        if (line.substr(0, key.size()) == key) value = line.substr(key.size());
+    }
+};
+
+#endif // COMMITFILE_H
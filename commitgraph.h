@@ -0,0 +1,139 @@
+// commitgraph.h
+#ifndef COMMITGRAPH_H
+#define COMMITGRAPH_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sha1.h"
+#include "byteio.h"
+#include "mappedfile.h"
+#include "lockfile.h"
+
+// ---------------------
+// Commit graph
+// ---------------------
+// Binary cache of the commit DAG so ancestry walks never open commit
+// files. Little-endian layout of .minigit/commit-graph:
+//
+//   "MGCG" | version u32
+//   per commit, parents always before children:
+//     hash 20 bytes | parent position u32 (NONE for a root) | generation u32 | timestamp i64
+//
+// A commit's generation is one more than its parent's (roots are 1), so
+// an ancestor always has a smaller generation than its descendants.
+// commitChanges appends one record per commit.
+class CommitGraph {
+public:
+    static constexpr uint32_t NONE = 0xFFFFFFFF;
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 8;
+    static constexpr size_t RECORD_SIZE = 36;
+
+    struct Record {
+        std::string hash;
+        uint32_t parent = NONE;
+        uint32_t generation = 1;
+        int64_t timestamp = 0;
+    };
+
+    // Returns false if the file is missing or malformed
+    bool load(const std::string &path) {
+        if (!file.open(path)) return false;
+        if (file.size() < HEADER_SIZE || std::memcmp(file.data(), "MGCG", 4) != 0 ||
+            byteio::getU32(file.data() + 4) != VERSION) {
+            file = MappedFile();
+            return false;
+        }
+        count = static_cast<uint32_t>((file.size() - HEADER_SIZE) / RECORD_SIZE);
+        return true;
+    }
+
+    uint32_t size() const { return count; }
+
+    // Position of a commit, or NONE. Scans newest first, since the commits
+    // looked up are almost always branch tips.
+    uint32_t find(const std::string &hash) const {
+        if (hash.size() != 40) return NONE;
+        uint8_t raw[20];
+        rawFromHex(hash, raw);
+        for (uint32_t i = count; i-- > 0;) {
+            if (std::memcmp(record(i), raw, 20) == 0) return i;
+        }
+        return NONE;
+    }
+
+    std::string hash(uint32_t i) const { return hexFromRaw(record(i)); }
+    uint32_t parent(uint32_t i) const { return byteio::getU32(record(i) + 20); }
+    uint32_t generation(uint32_t i) const { return byteio::getU32(record(i) + 24); }
+    int64_t timestamp(uint32_t i) const { return static_cast<int64_t>(byteio::getU64(record(i) + 28)); }
+
+    // Walks the side with the higher generation up until both sides meet.
+    // Nothing below the lower of the two tips is ever visited.
+    uint32_t lowestCommonAncestor(uint32_t a, uint32_t b) const {
+        while (a != NONE && b != NONE && a != b) {
+            uint32_t genA = generation(a), genB = generation(b);
+            if (genA >= genB) a = parent(a);
+            if (genB >= genA) b = parent(b);
+        }
+        return (a == b) ? a : NONE;
+    }
+
+    static std::string encode(const Record &r) {
+        std::string out;
+        uint8_t raw[20];
+        rawFromHex(r.hash, raw);
+        out.append(reinterpret_cast<const char*>(raw), 20);
+        byteio::putU32(out, r.parent);
+        byteio::putU32(out, r.generation);
+        byteio::putU64(out, static_cast<uint64_t>(r.timestamp));
+        return out;
+    }
+
+    static std::string header() {
+        std::string out = "MGCG";
+        byteio::putU32(out, VERSION);
+        return out;
+    }
+
+    // Appends one commit with a single O_APPEND write, adding the header
+    // first if the file is new. Callers hold the graph's lock, so positions
+    // read from the graph still hold and only one writer adds the header.
+    static bool append(const std::string &path, const Record &r) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        std::string bytes = encode(r);
+        if (lseek(fd, 0, SEEK_END) == 0) bytes = header() + bytes;
+        bool ok = ::write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size());
+        ::close(fd);
+        return ok;
+    }
+
+    // Rewrites the whole graph. Records must already be parent-first.
+    static bool write(const std::string &path, const std::vector<Record> &records) {
+        std::string bytes = header();
+        for (const auto &r : records) bytes += encode(r);
+
+        LockFile lock;
+        if (!lock.acquire(path)) return false;
+        FILE *out = std::fopen(lock.lockPath().c_str(), "wb");
+        if (!out) return false;
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+        ok = (std::fclose(out) == 0) && ok;
+        return ok && lock.commit();
+    }
+
+private:
+    MappedFile file;
+    uint32_t count = 0;
+
+    const uint8_t *record(uint32_t i) const {
+        return file.data() + HEADER_SIZE + static_cast<size_t>(i) * RECORD_SIZE;
+    }
+};
+
+#endif // COMMITGRAPH_H
@@ -0,0 +1,310 @@
+// diff.h
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <istream>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+// ---------------------
+// Line interning
+// ---------------------
+// Maps every distinct line to a small integer, so the diff algorithms
+// compare lines with one integer compare instead of a string compare.
+// Both sides of a diff must share one interner.
+class LineInterner {
+public:
+    uint32_t intern(const std::string &line) {
+        auto [it, inserted] = ids.emplace(line, static_cast<uint32_t>(ids.size()));
+        return it->second;
+    }
+
+    std::vector<uint32_t> internAll(const std::vector<std::string> &lines) {
+        std::vector<uint32_t> out;
+        out.reserve(lines.size());
+        for (const auto &line : lines) out.push_back(intern(line));
+        return out;
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> ids;
+};
+
+// Interns lines by a 64-bit hash of their text instead of the text itself,
+// so a large file can be diffed while only its line IDs stay in memory.
+// Distinct lines colliding on the full 64-bit hash would compare equal.
+class HashedLineInterner {
+public:
+    uint32_t intern(std::string_view line) {
+        uint64_t h = std::hash<std::string_view>{}(line);
+        auto [it, inserted] = ids.emplace(h, static_cast<uint32_t>(ids.size()));
+        return it->second;
+    }
+
+    std::vector<uint32_t> internStream(std::istream &in) {
+        std::vector<uint32_t> out;
+        std::string line;
+        while (std::getline(in, line)) out.push_back(intern(line));
+        return out;
+    }
+
+private:
+    std::unordered_map<uint64_t, uint32_t> ids;
+};
+
+inline std::vector<std::string> readLines(std::istream &in) {
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) lines.push_back(line);
+    return lines;
+}
+
+// ---------------------
+// Diff algorithms
+// ---------------------
+enum class DiffAlgorithm { Myers, Histogram };
+
+// deleted[i] marks line i of the old side as removed, inserted[j] marks
+// line j of the new side as added; every unmarked line is common to both.
+struct DiffResult {
+    std::vector<char> deleted;
+    std::vector<char> inserted;
+};
+
+namespace diff_detail {
+
+struct Range {
+    int aLo, aHi, bLo, bHi;
+};
+
+class Differ {
+public:
+    Differ(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, DiffResult &result)
+        : a(a), b(b), result(result) {
+        size_t diagonals = a.size() + b.size() + 3;
+        forward.resize(diagonals);
+        backward.resize(diagonals);
+        diagonalOffset = static_cast<int>(b.size()) + 1;
+    }
+
+    // Myers' O(ND) algorithm in linear space: each step finds the middle
+    // snake of the shortest edit script and splits the problem there.
+    void myers(Range whole) {
+        std::vector<Range> work{whole};
+        while (!work.empty()) {
+            Range r = work.back();
+            work.pop_back();
+            if (!trim(r)) continue;
+
+            int splitA, splitB;
+            middleSnake(r, splitA, splitB);
+            work.push_back({splitA, r.aHi, splitB, r.bHi});
+            work.push_back({r.aLo, splitA, r.bLo, splitB});
+        }
+    }
+
+    // Histogram diff: anchor on the longest common run built around the
+    // line that occurs least often on the old side, then recurse on either
+    // side of it. Ranges with no usable anchor fall back to Myers.
+    void histogram(Range whole) {
+        const size_t MAX_OCCURRENCES = 64;
+        std::vector<Range> work{whole};
+
+        while (!work.empty()) {
+            Range r = work.back();
+            work.pop_back();
+            if (!trim(r)) continue;
+
+            // A fresh table per range: clear() on a table that once held the
+            // whole file costs its full bucket count every time
+            std::unordered_map<uint32_t, std::vector<int>> occurrences(r.aHi - r.aLo);
+            for (int i = r.aLo; i < r.aHi; ++i) occurrences[a[i]].push_back(i);
+
+            int bestA = -1, bestB = -1, bestLength = 0;
+            size_t bestCount = MAX_OCCURRENCES + 1;
+            for (int j = r.bLo; j < r.bHi;) {
+                auto it = occurrences.find(b[j]);
+                int next = j + 1;
+                if (it != occurrences.end() && it->second.size() <= bestCount) {
+                    for (int i : it->second) {
+                        int as = i, bs = j, ae = i, be = j;
+                        size_t count = it->second.size();
+                        while (as > r.aLo && bs > r.bLo && a[as - 1] == b[bs - 1]) {
+                            --as;
+                            --bs;
+                            count = std::min(count, occurrences[a[as]].size());
+                        }
+                        while (ae + 1 < r.aHi && be + 1 < r.bHi && a[ae + 1] == b[be + 1]) {
+                            ++ae;
+                            ++be;
+                            count = std::min(count, occurrences[a[ae]].size());
+                        }
+                        int length = ae - as + 1;
+                        if (count < bestCount || (count == bestCount && length > bestLength)) {
+                            bestA = as;
+                            bestB = bs;
+                            bestLength = length;
+                            bestCount = count;
+                        }
+                        next = std::max(next, be + 1);
+                    }
+                }
+                j = next;
+            }
+
+            if (bestA < 0) {
+                myers(r);
+                continue;
+            }
+            work.push_back({bestA + bestLength, r.aHi, bestB + bestLength, r.bHi});
+            work.push_back({r.aLo, bestA, r.bLo, bestB});
+        }
+    }
+
+private:
+    const std::vector<uint32_t> &a;
+    const std::vector<uint32_t> &b;
+    DiffResult &result;
+    std::vector<int> forward, backward;
+    int diagonalOffset;
+
+    // Strips the common prefix and suffix. Returns false once the range is
+    // fully resolved (one side empty), after marking what remains.
+    bool trim(Range &r) {
+        while (r.aLo < r.aHi && r.bLo < r.bHi && a[r.aLo] == b[r.bLo]) { ++r.aLo; ++r.bLo; }
+        while (r.aLo < r.aHi && r.bLo < r.bHi && a[r.aHi - 1] == b[r.bHi - 1]) { --r.aHi; --r.bHi; }
+        if (r.aLo == r.aHi || r.bLo == r.bHi) {
+            for (int i = r.aLo; i < r.aHi; ++i) result.deleted[i] = 1;
+            for (int j = r.bLo; j < r.bHi; ++j) result.inserted[j] = 1;
+            return false;
+        }
+        return true;
+    }
+
+    // Runs the forward and backward searches until their furthest-reaching
+    // paths overlap on some diagonal; (splitA, splitB) is that meeting point.
+    void middleSnake(const Range &r, int &splitA, int &splitB) {
+        int *kf = forward.data() + diagonalOffset;
+        int *kb = backward.data() + diagonalOffset;
+        const int minDiag = r.aLo - r.bHi, maxDiag = r.aHi - r.bLo;
+        const int fMid = r.aLo - r.bLo, bMid = r.aHi - r.bHi;
+        const bool odd = ((fMid - bMid) & 1) != 0;
+        const int farBack = static_cast<int>(a.size()) + 1;
+        int fMin = fMid, fMax = fMid, bMin = bMid, bMax = bMid;
+        kf[fMid] = r.aLo;
+        kb[bMid] = r.aHi;
+
+        for (;;) {
+            if (fMin > minDiag) kf[--fMin - 1] = -1; else ++fMin;
+            if (fMax < maxDiag) kf[++fMax + 1] = -1; else --fMax;
+            for (int d = fMax; d >= fMin; d -= 2) {
+                int x = kf[d - 1] >= kf[d + 1] ? kf[d - 1] + 1 : kf[d + 1];
+                int y = x - d;
+                while (x < r.aHi && y < r.bHi && a[x] == b[y]) { ++x; ++y; }
+                kf[d] = x;
+                if (odd && bMin <= d && d <= bMax && kb[d] <= x) {
+                    splitA = x;
+                    splitB = y;
+                    return;
+                }
+            }
+
+            if (bMin > minDiag) kb[--bMin - 1] = farBack; else ++bMin;
+            if (bMax < maxDiag) kb[++bMax + 1] = farBack; else --bMax;
+            for (int d = bMax; d >= bMin; d -= 2) {
+                int x = kb[d - 1] < kb[d + 1] ? kb[d - 1] : kb[d + 1] - 1;
+                int y = x - d;
+                while (x > r.aLo && y > r.bLo && a[x - 1] == b[y - 1]) { --x; --y; }
+                kb[d] = x;
+                if (!odd && fMin <= d && d <= fMax && x <= kf[d]) {
+                    splitA = x;
+                    splitB = y;
+                    return;
+                }
+            }
+        }
+    }
+};
+
+} // namespace diff_detail
+
+inline DiffResult diffLines(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+                            DiffAlgorithm algorithm = DiffAlgorithm::Myers) {
+    DiffResult result;
+    result.deleted.assign(a.size(), 0);
+    result.inserted.assign(b.size(), 0);
+
+    diff_detail::Differ differ(a, b, result);
+    diff_detail::Range whole{0, static_cast<int>(a.size()), 0, static_cast<int>(b.size())};
+    if (algorithm == DiffAlgorithm::Histogram) differ.histogram(whole);
+    else differ.myers(whole);
+    return result;
+}
+
+// ---------------------
+// Unified output
+// ---------------------
+// Writes the result as unified-diff hunks with `context` lines of context.
+// Returns false, writing nothing, when the two sides are identical.
+inline bool writeUnifiedDiff(std::ostream &out, const std::string &nameA, const std::string &nameB,
+                             const std::vector<std::string> &linesA, const std::vector<std::string> &linesB,
+                             const DiffResult &result, int context = 3) {
+    struct Change {
+        int aStart, aEnd, bStart, bEnd;
+    };
+    std::vector<Change> changes;
+    int n = static_cast<int>(linesA.size()), m = static_cast<int>(linesB.size());
+    for (int i = 0, j = 0; i < n || j < m;) {
+        if ((i < n && result.deleted[i]) || (j < m && result.inserted[j])) {
+            Change c{i, i, j, j};
+            while (c.aEnd < n && result.deleted[c.aEnd]) ++c.aEnd;
+            while (c.bEnd < m && result.inserted[c.bEnd]) ++c.bEnd;
+            changes.push_back(c);
+            i = c.aEnd;
+            j = c.bEnd;
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+    if (changes.empty()) return false;
+
+    out << "--- " << nameA << "\n";
+    out << "+++ " << nameB << "\n";
+
+    for (size_t first = 0; first < changes.size();) {
+        // Merge changes whose context would overlap into one hunk
+        size_t last = first;
+        while (last + 1 < changes.size() && changes[last + 1].aStart - changes[last].aEnd <= 2 * context) ++last;
+
+        int lead = std::min(context, changes[first].aStart);
+        int aStart = changes[first].aStart - lead;
+        int bStart = changes[first].bStart - lead;
+        int trail = std::min(context, n - changes[last].aEnd);
+        int aEnd = changes[last].aEnd + trail;
+        int bEnd = changes[last].bEnd + trail;
+        int aLen = aEnd - aStart, bLen = bEnd - bStart;
+
+        out << "@@ -" << (aLen ? aStart + 1 : aStart) << "," << aLen
+            << " +" << (bLen ? bStart + 1 : bStart) << "," << bLen << " @@\n";
+
+        int i = aStart;
+        for (size_t c = first; c <= last; ++c) {
+            for (; i < changes[c].aStart; ++i) out << " " << linesA[i] << "\n";
+            for (; i < changes[c].aEnd; ++i) out << "-" << linesA[i] << "\n";
+            for (int j = changes[c].bStart; j < changes[c].bEnd; ++j) out << "+" << linesB[j] << "\n";
+        }
+        for (; i < aEnd; ++i) out << " " << linesA[i] << "\n";
+
+        first = last + 1;
+    }
+    return true;
+}
+
+#endif // DIFF_H
@@ -0,0 +1,222 @@
+// index.h
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+#include "sha1.h"
+#include "lockfile.h"
+#include "trace.h"
+
+// ---------------------
+// Stat data
+// ---------------------
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint64_t inode = 0;
+};
+
+inline bool statFile(const std::string &path, FileStat &out) {
+    trace::count(trace::FileStats);
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    out.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+}
+
+// ---------------------
+// Staging index
+// ---------------------
+// On-disk layout of .minigit/index, all integers little-endian:
+//
+//   "MGIX" | version u32 | entry count u32
+//   per entry, sorted by path:
+//     size u64 | mtime ns i64 | inode u64 | hash 20 bytes | path length u16 | path
+//   cached tree count u32 (version 2 and later)
+//   per cached tree, sorted by directory:
+//     hash 20 bytes | directory length u16 | directory ("" for the root)
+//
+// Each path appears once; staging it again replaces the entry. The tree
+// cache remembers the tree object last written for each directory, so a
+// commit only rebuilds trees for directories whose entries changed since.
+struct IndexEntry {
+    std::string path;
+    std::string hash;     // 40-char hex blob hash
+    FileStat stat;        // zeroed when the entry did not come from the working tree
+};
+
+class StagingIndex {
+public:
+    static constexpr uint32_t VERSION = 2;
+
+    // Returns false if the index file is missing or unreadable
+    bool load(const std::string &indexPath) {
+        trace::Span span("index.load");
+        entries.clear();
+        trees.clear();
+        std::ifstream in(indexPath, std::ios::binary);
+        if (!in.is_open()) return false;
+
+        char magic[4];
+        uint32_t version = 0, count = 0;
+        if (!in.read(magic, 4) || std::memcmp(magic, "MGIX", 4) != 0 ||
+            !readInt(in, version) || version < 1 || version > VERSION || !readInt(in, count)) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            IndexEntry entry;
+            uint8_t rawHash[20];
+            uint16_t pathLength = 0;
+            if (!readInt(in, entry.stat.size) || !readInt(in, entry.stat.mtimeNs) ||
+                !readInt(in, entry.stat.inode) || !in.read(reinterpret_cast<char*>(rawHash), 20) ||
+                !readInt(in, pathLength)) {
+                entries.clear();
+                return false;
+            }
+            entry.path.resize(pathLength);
+            if (!in.read(&entry.path[0], pathLength)) {
+                entries.clear();
+                return false;
+            }
+            entry.hash = hexFromRaw(rawHash);
+            entries.emplace(entry.path, std::move(entry));
+        }
+
+        uint32_t treeCount = 0;
+        if (version >= 2 && !readInt(in, treeCount)) treeCount = 0;
+        for (uint32_t i = 0; i < treeCount; ++i) {
+            uint8_t rawHash[20];
+            uint16_t dirLength = 0;
+            std::string dir;
+            if (!in.read(reinterpret_cast<char*>(rawHash), 20) || !readInt(in, dirLength)) break;
+            dir.resize(dirLength);
+            if (dirLength > 0 && !in.read(&dir[0], dirLength)) break;
+            trees[dir] = hexFromRaw(rawHash);
+        }
+
+        FileStat indexStat;
+        indexMtimeNs = statFile(indexPath, indexStat) ? indexStat.mtimeNs : 0;
+        return true;
+    }
+
+    // Writes the sorted index under its lock file and renames it into place
+    bool save(const std::string &indexPath) const {
+        LockFile lock;
+        return lock.acquire(indexPath) && save(lock);
+    }
+
+    // Writes into a lock already held on the index, for callers that read,
+    // modify and write it under one lock, and commits the lock
+    bool save(LockFile &lock) const {
+        trace::Span span("index.save");
+        std::ofstream out(lock.lockPath(), std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+
+        out.write("MGIX", 4);
+        writeInt(out, VERSION);
+        writeInt(out, static_cast<uint32_t>(entries.size()));
+        for (const auto &[path, entry] : entries) {
+            uint8_t rawHash[20];
+            rawFromHex(entry.hash, rawHash);
+            writeInt(out, entry.stat.size);
+            writeInt(out, entry.stat.mtimeNs);
+            writeInt(out, entry.stat.inode);
+            out.write(reinterpret_cast<const char*>(rawHash), 20);
+            writeInt(out, static_cast<uint16_t>(path.size()));
+            out.write(path.data(), path.size());
+        }
+        writeInt(out, static_cast<uint32_t>(trees.size()));
+        for (const auto &[dir, hash] : trees) {
+            uint8_t rawHash[20];
+            rawFromHex(hash, rawHash);
+            out.write(reinterpret_cast<const char*>(rawHash), 20);
+            writeInt(out, static_cast<uint16_t>(dir.size()));
+            out.write(dir.data(), dir.size());
+        }
+        out.close();
+        return !out.fail() && lock.commit();
+    }
+
+    const IndexEntry *find(const std::string &path) const {
+        auto it = entries.find(path);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+
+    void upsert(IndexEntry entry) {
+        std::string key = entry.path;
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.hash != entry.hash) invalidateTrees(key);
+        entries[key] = std::move(entry);
+    }
+
+    void erase(const std::string &path) {
+        if (entries.erase(path)) invalidateTrees(path);
+    }
+
+    // Tree object hash last written for a directory ("" is the root), or ""
+    // if an entry under it changed since
+    std::string cachedTree(const std::string &dir) const {
+        auto it = trees.find(dir);
+        return it == trees.end() ? "" : it->second;
+    }
+
+    void cacheTree(const std::string &dir, const std::string &hash) { trees[dir] = hash; }
+
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+    const std::map<std::string, IndexEntry> &all() const { return entries; }
+
+    // True when the stat data proves the file still matches the entry.
+    // Files modified in the same timestamp tick the index was written in
+    // are "racily clean" and must be rehashed, as in git.
+    bool isClean(const IndexEntry &entry, const FileStat &current) const {
+        return entry.stat.size == current.size &&
+               entry.stat.mtimeNs == current.mtimeNs &&
+               entry.stat.inode == current.inode &&
+               entry.stat.mtimeNs != 0 &&
+               entry.stat.mtimeNs < indexMtimeNs;
+    }
+
+private:
+    std::map<std::string, IndexEntry> entries;
+    std::map<std::string, std::string> trees;
+    int64_t indexMtimeNs = 0;
+
+    // Drops the cached trees of every directory containing `path`
+    void invalidateTrees(const std::string &path) {
+        for (size_t slash = path.rfind('/'); slash != std::string::npos; slash = path.rfind('/', slash - 1)) {
+            trees.erase(path.substr(0, slash));
+            if (slash == 0) break;
+        }
+        trees.erase("");
+    }
+
+    template <typename T>
+    static bool readInt(std::istream &in, T &value) {
+        uint8_t bytes[sizeof(T)];
+        if (!in.read(reinterpret_cast<char*>(bytes), sizeof(T))) return false;
+        uint64_t v = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) v |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+        value = static_cast<T>(v);
+        return true;
+    }
+
+    template <typename T>
+    static void writeInt(std::ostream &out, T value) {
+        uint8_t bytes[sizeof(T)];
+        uint64_t v = static_cast<uint64_t>(value);
+        for (size_t i = 0; i < sizeof(T); ++i) bytes[i] = static_cast<uint8_t>(v >> (i * 8));
+        out.write(reinterpret_cast<const char*>(bytes), sizeof(T));
+    }
+};
+
+#endif // INDEX_H
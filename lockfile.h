@@ -0,0 +1,90 @@
+// lockfile.h
+#ifndef LOCKFILE_H
+#define LOCKFILE_H
+
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ---------------------
+// Lock files
+// ---------------------
+// <path>.lock, created with O_EXCL, is both the lock on <path> and its next
+// version: the holder writes the new content to lockPath() and commit()
+// renames it over <path>, so readers see the old file or the new one and
+// two writers can never interleave. release() drops the lock and leaves
+// <path> alone, for holders that only need mutual exclusion, e.g. to
+// append in place.
+//
+// Writers that find the lock taken retry with jittered backoff until the
+// timeout. A lock left behind by a killed process has to be removed by
+// hand; busyMessage() says which file.
+class LockFile {
+public:
+    static constexpr std::chrono::milliseconds DEFAULT_TIMEOUT{10000};
+
+    LockFile() = default;
+    ~LockFile() { release(); }
+
+    LockFile(const LockFile&) = delete;
+    LockFile& operator=(const LockFile&) = delete;
+
+    bool acquire(const std::string &path, std::chrono::milliseconds timeout = DEFAULT_TIMEOUT) {
+        release();
+        target = path;
+        lock = path + ".lock";
+
+        thread_local std::minstd_rand jitter(std::random_device{}());
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::chrono::microseconds backoff(100);
+        for (;;) {
+            int fd = ::open(lock.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd >= 0) {
+                ::close(fd);
+                held = true;
+                return true;
+            }
+            if (errno != EEXIST || std::chrono::steady_clock::now() >= deadline) return false;
+
+            std::this_thread::sleep_for(backoff + std::chrono::microseconds(jitter() % backoff.count()));
+            backoff = std::min(backoff * 2, std::chrono::microseconds(20000));
+        }
+    }
+
+    bool isHeld() const { return held; }
+
+    // Where the holder writes the new version of the file
+    const std::string &lockPath() const { return lock; }
+
+    // Replaces the file with the lock's content, which releases the lock
+    bool commit() {
+        if (!held) return false;
+        held = false;
+        if (std::rename(lock.c_str(), target.c_str()) == 0) return true;
+        std::remove(lock.c_str());
+        return false;
+    }
+
+    void release() {
+        if (!held) return;
+        held = false;
+        std::remove(lock.c_str());
+    }
+
+    static std::string busyMessage(const std::string &path) {
+        return "Unable to lock " + path + ": another minigit process is updating it. If none is running, remove " +
+               path + ".lock and retry.";
+    }
+
+private:
+    std::string target, lock;
+    bool held = false;
+};
+
+#endif // LOCKFILE_H
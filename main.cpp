@@ -4,626 +4,553 @@
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <filesystem>
-#include <chrono>
-#include <ctime>
 #include <vector>
-#include <map>
-#include <set>
-#include "sha1.h"
+#include <filesystem>
+#include "repository.h"
+#include "server.h"
+#include "trace.h"
 
 using namespace std;
 namespace fs = filesystem;
 
-// ---------------------
-// Hash Function
-// ---------------------
-string simpleHash(const string& content) {
-    return sha1(content);
+// The command-line front end: parses arguments, runs the operation on
+// the repository in the current directory and prints its result. The
+// Repository lives for the whole process, so batch and daemon runs keep
+// its caches warm between commands.
+Repository& repository() {
+    static Repository repo(".");
+    return repo;
 }
 
 // ---------------------
 // INIT Command
 // ---------------------
-void initMiniGit() {
-    string baseDir = ".minigit";
-
-    if (fs::exists(baseDir)) {
-        cout << "MiniGit repo already initialized.\n";
-        return;
+int initMiniGit() {
+    OpResult result = repository().init();
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
-
-    fs::create_directory(baseDir);
-    fs::create_directory(baseDir + "/objects");
-    fs::create_directory(baseDir + "/commits");
-    fs::create_directory(baseDir + "/branches");
-
-    ofstream headFile(baseDir + "/HEAD.txt");
-    headFile << "ref: main\n";
-    headFile.close();
-
     cout << "Initialized empty MiniGit repository in .minigit/\n";
+    return 0;
 }
 
 // ---------------------
 // ADD Command
 // ---------------------
-void addFileToStaging(const string& filename) {
-    string repoPath = ".minigit";
-
-    if (!fs::exists(repoPath)) {
-        cout << "Repository not initialized. Run './minigit init' first.\n";
-        return;
-    }
-
-    if (!fs::exists(filename)) {
-        cout << "File not found: " << filename << "\n";
-        return;
-    }
-
-    // Read file content
-    ifstream inFile(filename);
-    stringstream buffer;
-    buffer << inFile.rdbuf();
-    string content = buffer.str();
-    inFile.close();
-
-    // Generate hash
-    string hash = simpleHash(content);
-    string objectPath = repoPath + "/objects/" + hash;
+int addFilesToStaging(const vector<string>& paths) {
+    AddResult result = repository().add(paths);
+    for (const auto& path : result.missing) cout << "File not found: " << path << "\n";
+    for (const auto& path : result.outside) cout << "Outside the repository: " << path << "\n";
+    for (const auto& path : result.failed) cout << "Failed to store blob for " << path << "\n";
+    for (const auto& path : result.added) cout << "Added '" << path << "' to staging area.\n";
+    for (const auto& path : result.removed) cout << "Removed '" << path << "' from staging area.\n";
+    if (!result.ok) cout << result.error << "\n";
+    return result.ok && result.missing.empty() && result.outside.empty() && result.failed.empty() ? 0 : 1;
+}
 
-    // Save blob if not already saved
-    if (!fs::exists(objectPath)) {
-        ofstream blobFile(objectPath);
-        blobFile << content;
-        blobFile.close();
+// ---------------------
+// COMMIT Command
+// ---------------------
+int commitChanges(const string& message) {
+    CommitResult result = repository().commit(message);
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
-
-    // Record staging info
-    ofstream indexFile(repoPath + "/index.txt", ios::app);
-    indexFile << filename << " " << hash << "\n";
-    indexFile.close();
-
-    cout << "Added '" << filename << "' to staging area.\n";
+    cout << "Committed with hash: " << result.hash << "\n";
+    return 0;
 }
 
-string getCurrentTimestamp() {
-    auto now = chrono::system_clock::now();
-    time_t currentTime = chrono::system_clock::to_time_t(now);
-    return string(ctime(&currentTime));
+// ---------------------
+// LOG Command
+// ---------------------
+int showCommitLog(const string& path) {
+    LogResult result = repository().log(path, [](const CommitInfo& commit) {
+        cout << "------------------------------\n";
+        cout << "Commit: " << commit.hash << "\n";
+        cout << "Date: " << commit.date << "\n";
+        cout << "Message: " << commit.message << "\n";
+        return true;
+    });
+    if (!result.ok) cout << result.error << "\n";
+    if (result.walked) cout << "------------------------------\n";
+    return result.ok ? 0 : 1;
 }
 
-void commitChanges(const string& message) {
-    string repoPath = ".minigit";
-    string indexPath = repoPath + "/index.txt";
-
-    if (!fs::exists(repoPath) || !fs::exists(indexPath)) {
-        cout << "Nothing to commit. Stage files first using './minigit add <file>'.\n";
-        return;
-    }
-
-    // Read staged files
-    ifstream indexFile(indexPath);
-    stringstream stagedContent;
-    stagedContent << indexFile.rdbuf();
-    string staged = stagedContent.str();
-    indexFile.close();
-
-    if (staged.empty()) {
-        cout << "No files staged for commit.\n";
-        return;
-    }
-
-    // Get parent commit from HEAD
-    string parentHash = "null";
-    ifstream headFile(repoPath + "/HEAD.txt");
-    string headContent;
-    if (getline(headFile, headContent)) {
-        if (headContent.rfind("ref:", 0) == 0) {
-            string branchName = headContent.substr(5);
-            ifstream branchFile(repoPath + "/branches/" + branchName + ".txt");
-            if (branchFile.is_open()) {
-                getline(branchFile, parentHash);
-                branchFile.close();
-            }
-        } else {
-            parentHash = headContent;  // detached HEAD
-        }
-    }
-    headFile.close();
-
-    // Generate commit hash
-    string timestamp = getCurrentTimestamp();
-    string commitContent = message + timestamp + staged;
-    string commitHash = simpleHash(commitContent);
-
-    // Write commit file
-    ofstream commitFile(repoPath + "/commits/" + commitHash + ".txt");
-    commitFile << "Commit: " << commitHash << "\n";
-    commitFile << "Parent: " << parentHash << "\n";
-    commitFile << "Date: " << timestamp;
-    commitFile << "Message: " << message << "\n";
-    commitFile << "Files:\n" << staged;
-    commitFile.close();
-
-    // Update HEAD if detached
-    ifstream recheckHead(repoPath + "/HEAD.txt");
-    getline(recheckHead, headContent);
-    recheckHead.close();
-
-    if (headContent.rfind("ref:", 0) == 0) {
-        string branchName = headContent.substr(5);
-        ofstream branchFile(repoPath + "/branches/" + branchName + ".txt");
-        branchFile << commitHash << "\n";
-        branchFile.close();
-    } else {
-        ofstream newHead(repoPath + "/HEAD.txt");
-        newHead << commitHash << "\n";
-        newHead.close();
+// ---------------------
+// BRANCH Command
+// ---------------------
+int createBranch(const string& branchName) {
+    BranchResult result = repository().createBranch(branchName);
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
-
-    // Clear staging area
-    ofstream clearIndex(indexPath, ios::trunc);
-    clearIndex.close();
-
-    cout << "Committed with hash: " << commitHash << "\n";
+    cout << "Created new branch '" << branchName << "' at commit: " << result.commit << "\n";
+    return 0;
 }
 
-void showCommitLog() {
-    string repoPath = ".minigit";
-    string headPath = repoPath + "/HEAD.txt";
-
-    if (!fs::exists(headPath)) {
-        cout << "Repository not initialized or no commits yet.\n";
-        return;
+// Lists branches, marking the checked-out one with "*"
+int listBranches() {
+    BranchListResult result = repository().listBranches();
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
-
-    ifstream headFile(headPath);
-    string headContent;
-    getline(headFile, headContent);
-    headFile.close();
-
-    string currentHash = headContent;
-
-    // If HEAD is a branch ref, resolve it
-    if (headContent.rfind("ref:", 0) == 0) {
-        string branchName = headContent.substr(5); // skip "ref: "
-        ifstream branchFile(repoPath + "/branches/" + branchName + ".txt");
-        if (!branchFile.is_open()) {
-            cout << "Error: Branch '" << branchName << "' not found.\n";
-            return;
-        }
-        getline(branchFile, currentHash);
-        branchFile.close();
+    for (const auto& [name, commit] : result.branches) {
+        cout << (name == result.current ? "* " : "  ") << name << "\n";
     }
-
-    // Traverse commit history
-    while (currentHash != "null") {
-        string commitPath = repoPath + "/commits/" + currentHash + ".txt";
-
-        if (!fs::exists(commitPath)) {
-            cout << "Error: Commit file missing for hash " << currentHash << "\n";
-            break;
-        }
-
-        ifstream commitFile(commitPath);
-        string line;
-        string parentHash = "null";
-
-        cout << "------------------------------\n";
-
-        while (getline(commitFile, line)) {
-            if (line.rfind("Commit:", 0) == 0 ||
-                line.rfind("Date:", 0) == 0 ||
-                line.rfind("Message:", 0) == 0) {
-                cout << line << "\n";
-            }
-
-            if (line.rfind("Parent:", 0) == 0) {
-                parentHash = line.substr(8); // skip "Parent: "
-            }
-        }
-
-        commitFile.close();
-        currentHash = parentHash;
-    }
-
-    cout << "------------------------------\n";
+    return 0;
 }
 
-void createBranch(const string& branchName) {
-    string repoPath = ".minigit";
-    string headPath = repoPath + "/HEAD.txt";
-    string branchPath = repoPath + "/branches/" + branchName + ".txt";
-
-    if (!fs::exists(headPath)) {
-        cout << "Repository not initialized.\n";
-        return;
+// ---------------------
+// PACK-REFS Command
+// ---------------------
+int packRefs() {
+    PackRefsResult result = repository().packRefs();
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
+    cout << "Packed " << result.packed << " branches (" << result.pruned << " loose files removed).\n";
+    return 0;
+}
 
-    if (fs::exists(branchPath)) {
-        cout << "Branch '" << branchName << "' already exists.\n";
-        return;
+// ---------------------
+// CHECKOUT Command
+// ---------------------
+int checkoutTarget(const string& target) {
+    CheckoutResult result = repository().checkout(target);
+    if (!result.blocked.empty()) {
+        cout << "Your local changes to the following files would be overwritten by checkout:\n";
+        for (const auto& filename : result.blocked) cout << "  " << filename << "\n";
+        cout << "Commit them or discard them, then retry. Checkout aborted.\n";
+        return 1;
     }
-
-    ifstream headFile(headPath);
-    string headContent;
-    getline(headFile, headContent);
-    headFile.close();
-
-    string currentCommitHash;
-
-    if (headContent.rfind("ref:", 0) == 0) {
-        string currentBranch = headContent.substr(5); // e.g. "main"
-        string branchFilePath = repoPath + "/branches/" + currentBranch + ".txt";
-
-        // If the branch doesn't exist yet, we likely haven't committed yet
-        if (!fs::exists(branchFilePath)) {
-            cout << "Error: Cannot create branch before first commit on current branch '" 
-                      << currentBranch << "'.\n";
-            return;
-        }
-
-        ifstream branchFile(branchFilePath);
-        getline(branchFile, currentCommitHash);
-        branchFile.close();
-    } else {
-        // HEAD is a commit hash directly (e.g., after checkout)
-        currentCommitHash = headContent;
+    for (const auto& [filename, error] : result.writeErrors) cout << "Failed to write " << filename << ": " << error << "\n";
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
-
-    // Create new branch pointing to the current commit
-    ofstream newBranch(branchPath);
-    newBranch << currentCommitHash << "\n";
-    newBranch.close();
-
-    cout << "Created new branch '" << branchName << "' at commit: " << currentCommitHash << "\n";
+    cout << "Checked out " << (result.isBranch ? "branch" : "commit") << ": " << target
+         << " (" << result.written << " written, " << result.removed << " removed)\n";
+    return result.writeErrors.empty() ? 0 : 1;
 }
 
-void checkoutTarget(const string& target) {
-    string repoPath = ".minigit";
-    string commitHash = target;
-    bool isBranch = false;
-
-    // Check if target is a branch name
-    string branchPath = repoPath + "/branches/" + target + ".txt";
-    if (fs::exists(branchPath)) {
-        isBranch = true;
-        ifstream branchFile(branchPath);
-        getline(branchFile, commitHash);
-        branchFile.close();
-    }
-
-    // Validate commit hash
-    string commitFilePath = repoPath + "/commits/" + commitHash + ".txt";
-    if (!fs::exists(commitFilePath)) {
-        cout << "Commit not found for: " << target << "\n";
-        return;
+// ---------------------
+// MERGE Command
+// ---------------------
+int mergeBranch(const string& targetBranch) {
+    MergeResult result = repository().merge(targetBranch);
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
 
-    // Read commit file to get file list
-    ifstream commitFile(commitFilePath);
-    string line;
-    bool inFilesSection = false;
-    vector<pair<string, string>> files;
-
-    while (getline(commitFile, line)) {
-        if (line == "Files:") {
-            inFilesSection = true;
-            continue;
-        }
-
-        if (inFilesSection && !line.empty()) {
-            istringstream ss(line);
-            string filename, hash;
-            ss >> filename >> hash;
-            files.emplace_back(filename, hash);
-        }
-    }
-    commitFile.close();
-
-    // Overwrite working directory files
-    for (const auto& [filename, hash] : files) {
-        string blobPath = repoPath + "/objects/" + hash;
-        if (fs::exists(blobPath)) {
-            ifstream blobFile(blobPath);
-            ofstream outFile(filename);
-            outFile << blobFile.rdbuf();
-            blobFile.close();
-            outFile.close();
-        } else {
-            cout << "Missing blob for " << filename << "\n";
+    cout << "Merging branch '" << targetBranch << "' into '" << result.currentBranch << "'\n";
+    cout << "Lowest Common Ancestor: " << result.lca << "\n";
+    int status = 0;
+    for (const auto& file : result.files) {
+        string renamed = file.targetPath.empty() ? "" : " (" + file.targetPath + " on " + targetBranch + ")";
+        switch (file.outcome) {
+            case MergedFile::Outcome::Conflict:
+                cout << "CONFLICT: both modified " << file.path << renamed << " (" << file.conflicts
+                     << " conflicting region" << (file.conflicts == 1 ? "" : "s") << ")\n";
+                break;
+            case MergedFile::Outcome::AutoMerged:
+                cout << "Auto-merged " << file.path << renamed << "\n";
+                break;
+            case MergedFile::Outcome::TakenFromTarget:
+                cout << "Merged change from " << targetBranch << ": " << file.path << renamed << "\n";
+                break;
+            case MergedFile::Outcome::WriteFailed:
+                cout << "Failed to write " << file.path << ": " << file.error << "\n";
+                status = 1;
+                break;
         }
     }
-
-    // Update HEAD
-    ofstream headFile(repoPath + "/HEAD.txt");
-    if (isBranch) {
-        headFile << "ref: " << target << "\n";
-    } else {
-        headFile << commitHash << "\n";  // detached
-    }
-    headFile.close();
-
-    cout << "Checked out " << (isBranch ? "branch" : "commit") << ": " << target << "\n";
+    cout << "Merge complete. Please resolve conflicts and commit the result.\n";
+    return status;
 }
 
-void mergeBranch(const string& targetBranch) {
-    string repoPath = ".minigit";
-
-    // 1. Get current branch from HEAD
-    ifstream headFile(repoPath + "/HEAD.txt");
-    string headContent;
-    getline(headFile, headContent);
-    headFile.close();
+// ---------------------
+// DIFF Command
+// ---------------------
+int diffCommits(const string& hash1, const string& hash2, DiffAlgorithm algorithm) {
+    CommitDiffResult result =
+        repository().diff(hash1, hash2, algorithm, [](const FileDiff& file) { cout << file.patch; });
+    if (!result.ok) cout << result.error << "\n";
+    return result.ok ? 0 : 1;
+}
 
-    if (headContent.rfind("ref:", 0) != 0) {
-        cout << "You must be on a branch to perform a merge (not detached).\n";
-        return;
+// ---------------------
+// STATUS Command
+// ---------------------
+int showStatus() {
+    StatusResult result = repository().status();
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
 
-    string currentBranch = headContent.substr(5);
-    string currentBranchPath = repoPath + "/branches/" + currentBranch + ".txt";
-    string targetBranchPath = repoPath + "/branches/" + targetBranch + ".txt";
-
-    if (!fs::exists(currentBranchPath) || !fs::exists(targetBranchPath)) {
-        cout << "Error: One or both branches do not exist.\n";
-        return;
+    if (result.staged.empty() && result.unstaged.empty() && result.untracked.empty()) {
+        cout << "Nothing to commit, working tree clean.\n";
+        return 0;
     }
 
-    // 2. Get commit hashes
-    ifstream currentFile(currentBranchPath), targetFile(targetBranchPath);
-    string currentHash, targetHash;
-    getline(currentFile, currentHash);
-    getline(targetFile, targetHash);
-    currentFile.close(); targetFile.close();
-
-    // 3. Find LCA
-    set<string> visited;
-    string walker = currentHash;
-
-    while (walker != "null") {
-        visited.insert(walker);
-
-        ifstream commitFile(repoPath + "/commits/" + walker + ".txt");
-        string line, parent = "null";
-        while (getline(commitFile, line)) {
-            if (line.rfind("Parent:", 0) == 0) {
-                parent = line.substr(8);
-                break;
-            }
+    auto label = [](StatusEntry::Kind kind) {
+        switch (kind) {
+            case StatusEntry::Kind::NewFile: return "new file:   ";
+            case StatusEntry::Kind::Modified: return "modified:   ";
+            case StatusEntry::Kind::Deleted: return "deleted:    ";
         }
-        commitFile.close();
-        walker = parent;
+        return "";
+    };
+    if (!result.staged.empty()) {
+        cout << "Changes to be committed:\n";
+        for (const auto& entry : result.staged) cout << "  " << label(entry.kind) << entry.path << "\n";
     }
-
-    string lca = "null";
-    walker = targetHash;
-    while (walker != "null") {
-        if (visited.count(walker)) {
-            lca = walker;
-            break;
-        }
-
-        ifstream commitFile(repoPath + "/commits/" + walker + ".txt");
-        string line, parent = "null";
-        while (getline(commitFile, line)) {
-            if (line.rfind("Parent:", 0) == 0) {
-                parent = line.substr(8);
-                break;
-            }
-        }
-        commitFile.close();
-        walker = parent;
+    if (!result.unstaged.empty()) {
+        cout << "Changes not staged for commit:\n";
+        for (const auto& entry : result.unstaged) cout << "  " << label(entry.kind) << entry.path << "\n";
     }
-
-    if (lca == "null") {
-        cout << "No common ancestor. Cannot merge.\n";
-        return;
+    if (!result.untracked.empty()) {
+        cout << "Untracked files:\n";
+        for (const auto& path : result.untracked) cout << "  " << path << "\n";
     }
+    return 0;
+}
 
-    cout << "Merging branch '" << targetBranch << "' into '" << currentBranch << "'\n";
-    cout << "Lowest Common Ancestor: " << lca << "\n";
-
-    // 4. Load file lists for each commit
-    auto loadFiles = [&](const string& hash) {
-        map<string, string> files;
-        ifstream file(repoPath + "/commits/" + hash + ".txt");
-        string line;
-        bool inFiles = false;
-        while (getline(file, line)) {
-            if (line == "Files:") {
-                inFiles = true;
-                continue;
-            }
-            if (inFiles && !line.empty()) {
-                istringstream ss(line);
-                string filename, blob;
-                ss >> filename >> blob;
-                files[filename] = blob;
-            }
-        }
-        file.close();
-        return files;
-    };
-
-    auto lcaFiles = loadFiles(lca);
-    auto currentFiles = loadFiles(currentHash);
-    auto targetFiles = loadFiles(targetHash);
-
-    // 5. Perform 3-way merge
-    for (const auto& [filename, lcaBlob] : lcaFiles) {
-        string blobA = currentFiles[filename];
-        string blobB = targetFiles[filename];
-
-        if (blobA == blobB || blobB.empty()) {
-            continue; // same or deleted in target, no merge needed
-        }
-
-        if (blobA != lcaBlob && blobB != lcaBlob && blobA != blobB) {
-            cout << "CONFLICT: both modified " << filename << "\n";
-
-            // Write conflict marker file
-            ofstream out(filename);
-            out << "<<<<<<< current\n";
-            ifstream a(repoPath + "/objects/" + blobA);
-            out << a.rdbuf(); a.close();
-
-            out << "\n=======\n";
-            ifstream b(repoPath + "/objects/" + blobB);
-            out << b.rdbuf(); b.close();
-
-            out << "\n>>>>>>> " << targetBranch << "\n";
-            out.close();
-        } else {
-            // Apply non-conflicting change
-            string blob = blobB;
-            ifstream in(repoPath + "/objects/" + blob);
-            ofstream out(filename);
-            out << in.rdbuf();
-            in.close();
-            out.close();
-            cout << "Merged change from " << targetBranch << ": " << filename << "\n";
-        }
+// ---------------------
+// MIGRATE-OBJECTS Command
+// ---------------------
+int migrateObjects() {
+    MigrateResult result = repository().migrateObjects();
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
-
-    cout << "Merge complete. Please resolve conflicts and commit the result.\n";
+    cout << "Moved " << result.moved << " objects into the fan-out layout.\n";
+    return 0;
 }
 
-void diffCommits(const string& hash1, const string& hash2) {
-    string repoPath = ".minigit";
-
-    auto loadFiles = [&](const string& hash) -> map<string, string> {
-        map<string, string> files;
-        ifstream commitFile(repoPath + "/commits/" + hash + ".txt");
-        if (!commitFile.is_open()) {
-            cout << "Commit not found: " << hash << "\n";
-            return files;
-        }
-
-        string line;
-        bool inFiles = false;
-        while (getline(commitFile, line)) {
-            if (line == "Files:") {
-                inFiles = true;
-                continue;
-            }
-            if (inFiles && !line.empty()) {
-                istringstream ss(line);
-                string filename, blobHash;
-                ss >> filename >> blobHash;
-                files[filename] = blobHash;
-            }
-        }
-        commitFile.close();
-        return files;
-    };
-
-    auto files1 = loadFiles(hash1);
-    auto files2 = loadFiles(hash2);
-
-    for (const auto& [filename, blob1] : files1) {
-        if (files2.find(filename) == files2.end()) continue; // only diff shared files
-
-        string blob2 = files2[filename];
-        ifstream file1(repoPath + "/objects/" + blob1);
-        ifstream file2(repoPath + "/objects/" + blob2);
-
-        vector<string> lines1, lines2;
-        string line;
-
-        while (getline(file1, line)) lines1.push_back(line);
-        while (getline(file2, line)) lines2.push_back(line);
-
-        file1.close(); file2.close();
-
-        cout << "Diff: " << filename << "\n";
-
-        size_t maxLines = max(lines1.size(), lines2.size());
-
-        for (size_t i = 0; i < maxLines; ++i) {
-            string a = i < lines1.size() ? lines1[i] : "";
-            string b = i < lines2.size() ? lines2[i] : "";
-
-            if (a != b) {
-                if (!a.empty()) cout << "- " << a << "\n";
-                if (!b.empty()) cout << "+ " << b << "\n";
-            }
-        }
-
-        cout << "--------------------------\n";
+// ---------------------
+// REPACK Command
+// ---------------------
+int repackObjects() {
+    RepackResult result = repository().repack();
+    for (const auto& hash : result.skipped) cout << "Skipping unreadable object " << hash << "\n";
+    if (!result.ok) {
+        cout << result.error << "\n";
+        return 1;
     }
+    if (result.packed == 0) {
+        cout << "Nothing to pack.\n";
+        return 0;
+    }
+    cout << "Packed " << result.packed << " objects (" << result.deltas << " deltas) into " << result.packName << ".pack\n";
+    cout << "Loose objects: " << result.looseBytes << " bytes, pack: " << result.packBytes << " bytes\n";
+    return 0;
 }
 
 // ---------------------
-// Main Function
+// Command Dispatch
 // ---------------------
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
+// Runs one command given as its words, e.g. {"commit", "-m", "msg"}.
+// Returns the command's exit status: 0 on success, 1 for an unknown or
+// incomplete command or one whose operation failed.
+int runCommand(const vector<string>& args) {
+    if (args.empty()) {
         cout << "Usage: ./minigit <command> [options]\n";
         return 1;
     }
 
-    string command = argv[1];
+    const string& command = args[0];
+    size_t argc = args.size();
 
     // ---------------------
     // INIT Command Handler
     // ---------------------
     if (command == "init") {
-        initMiniGit();
+        return initMiniGit();
     } 
     // ---------------------
     // ADD Command Handler
     // ---------------------
-    else if (command == "add" && argc >= 3) {
-        string filename = argv[2];
-        addFileToStaging(filename);
+    else if (command == "add" && argc >= 2) {
+        vector<string> paths(args.begin() + 1, args.end());
+        return addFilesToStaging(paths);
     } 
     // ---------------------
     // COMMIT Command Handler
     // ---------------------
-    else if (command == "commit" && argc >= 4 && string(argv[2]) == "-m") {
-        string message = argv[3];
-        commitChanges(message);
+    else if (command == "commit" && argc >= 3 && args[1] == "-m") {
+        string message = args[2];
+        return commitChanges(message);
     } 
     // ---------------------
     // LOG Command Handler
     // ---------------------
     else if (command == "log") {
-        showCommitLog();
+        string path;
+        if (argc >= 3 && args[1] == "--") path = args[2];
+        return showCommitLog(path);
     } 
     // ---------------------
     // BRANCH Command Handler
     // ---------------------
-    else if (command == "branch" && argc >= 3) {
-        string branchName = argv[2];
-        createBranch(branchName);
+    else if (command == "branch") {
+        return argc >= 2 ? createBranch(args[1]) : listBranches();
     } 
     // ---------------------
     // CHECKOUT Command Handler
     // ---------------------
-    else if (command == "checkout" && argc >= 3) {
-        string target = argv[2];
-        checkoutTarget(target);
+    else if (command == "checkout" && argc >= 2) {
+        string target = args[1];
+        return checkoutTarget(target);
     } 
     // ---------------------
     // MERGE Command Handler
     // ---------------------
-    else if (command == "merge" && argc >= 3) {
-        mergeBranch(argv[2]);
+    else if (command == "merge" && argc >= 2) {
+        return mergeBranch(args[1]);
     } 
     // ---------------------
     // DIFF Command Handler
     // ---------------------
-    else if (command == "diff" && argc >= 4) {
-        diffCommits(argv[2], argv[3]);
+    else if (command == "diff" && argc >= 3) {
+        DiffAlgorithm algorithm = DiffAlgorithm::Myers;
+        vector<string> commits;
+        for (size_t i = 1; i < argc; ++i) {
+            if (args[i] == "--histogram") algorithm = DiffAlgorithm::Histogram;
+            else commits.push_back(args[i]);
+        }
+        if (commits.size() == 2) return diffCommits(commits[0], commits[1], algorithm);
+        cout << "Usage: ./minigit diff [--histogram] <commit1> <commit2>\n";
+        return 1;
     } 
     // ---------------------
+    // STATUS Command Handler
+    // ---------------------
+    else if (command == "status") {
+        return showStatus();
+    }
+    // ---------------------
+    // MIGRATE-OBJECTS Command Handler
+    // ---------------------
+    else if (command == "migrate-objects") {
+        return migrateObjects();
+    }
+    // ---------------------
+    // REPACK Command Handler
+    // ---------------------
+    else if (command == "repack") {
+        return repackObjects();
+    }
+    // ---------------------
+    // PACK-REFS Command Handler
+    // ---------------------
+    else if (command == "pack-refs") {
+        return packRefs();
+    }
+    // ---------------------
     // Unknown Command Handler
     // ---------------------
     else {
         cout << "Unknown or incomplete command.\n";
+        return 1;
     }
+}
+
+// ---------------------
+// BATCH and DAEMON Modes
+// ---------------------
+// Both run many commands in one process, so the session caches above stay
+// warm between them. A request is one line holding a command without the
+// program name, words split on whitespace, with double quotes grouping
+// words and backslash escaping the next character:
+//
+//   commit -m "fix \"quoted\" bug"
+//
+// Each reply is one line of JSON, in request order:
+//
+//   {"id":1,"status":0,"output":"Committed with hash: ...\n"}
+//
+// where id counts requests from 1 and status is the command's exit status:
+// 0 on success, 1 for an unknown command or one that failed or threw.
+vector<string> splitCommandLine(const string& line) {
+    vector<string> words;
+    string word;
+    bool inWord = false, quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '\\' && i + 1 < line.size()) {
+            word += line[++i];
+            inWord = true;
+        } else if (c == '"') {
+            quoted = !quoted;
+            inWord = true;
+        } else if (!quoted && isspace(static_cast<unsigned char>(c))) {
+            if (inWord) words.push_back(move(word));
+            word.clear();
+            inWord = false;
+        } else {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord) words.push_back(move(word));
+    return words;
+}
 
+string jsonEscape(const string& text) {
+    string out;
+    out.reserve(text.size());
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out;
+}
+
+// Runs one request line with cout captured and returns its JSON reply
+string runRequest(const string& line, uint64_t id) {
+    ostringstream captured;
+    streambuf* original = cout.rdbuf(captured.rdbuf());
+    int status = 1;
+    try {
+        status = runCommand(splitCommandLine(line));
+    } catch (const exception& e) {
+        cout << "Error: " << e.what() << "\n";
+    }
+    cout.rdbuf(original);
+
+    return "{\"id\":" + to_string(id) + ",\"status\":" + to_string(status) + ",\"output\":\"" +
+           jsonEscape(captured.str()) + "\"}";
+}
+
+// Reads requests from stdin until EOF. Blank lines are skipped.
+void runBatch() {
+    ios::sync_with_stdio(false);
+    uint64_t id = 0;
+    string line;
+    while (getline(cin, line)) {
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        string reply = runRequest(line, ++id);
+        cout << reply << "\n" << flush;
+    }
+}
+
+// Serves requests on a Unix socket until a client sends "shutdown". Ids
+// count requests across all clients.
+int runDaemon(const string& socketPath) {
+    if (!fs::exists(".minigit")) {
+        cout << "Repository not initialized.\n";
+        return 1;
+    }
+
+    uint64_t id = 0;
+    cout << "Listening on " << socketPath << "\n" << flush;
+    string error;
+    bool stopped = serveLines(socketPath, [&](const string& line, bool& stop) {
+        if (line == "shutdown") {
+            stop = true;
+            return "{\"id\":" + to_string(++id) + ",\"status\":0,\"output\":\"Daemon stopped.\\n\"}";
+        }
+        return runRequest(line, ++id);
+    }, error);
+
+    if (!stopped) {
+        cout << "Daemon failed: " << error << "\n";
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+// ---------------------
+// Tracing
+// ---------------------
+// ./minigit --trace[=MODE] <command> ..., or MINIGIT_TRACE=MODE. MODE is
+// "summary" (the default; also "1") for phase times and counters on stderr
+// after the command, or "chrome[:FILE]" for trace-event JSON written to
+// FILE, minigit-trace.json unless given.
+struct TraceOptions {
+    bool chrome = false;
+    string file = "minigit-trace.json";
+};
+
+bool parseTraceMode(const string& mode, TraceOptions& options) {
+    if (mode.empty() || mode == "1" || mode == "summary") return true;
+    if (mode.rfind("chrome", 0) != 0) return false;
+    options.chrome = true;
+    if (mode.size() > 6) {
+        if (mode[6] != ':' || mode.size() == 7) return false;
+        options.file = mode.substr(7);
+    }
+    return true;
+}
+
+void finishTrace(const TraceOptions& options) {
+    if (!options.chrome) {
+        trace::writeSummary(cerr);
+        return;
+    }
+    ofstream out(options.file);
+    trace::writeChromeTrace(out);
+    if (!out) cerr << "Could not write trace to " << options.file << "\n";
+}
+
+// ---------------------
+// Main Function
+// ---------------------
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+
+    TraceOptions traceOptions;
+    bool tracing = false;
+    if (!args.empty() && args[0].rfind("--trace", 0) == 0) {
+        string flag = args[0];
+        args.erase(args.begin());
+        bool valid = flag == "--trace" || (flag[7] == '=' && parseTraceMode(flag.substr(8), traceOptions));
+        if (!valid) {
+            cout << "Unknown trace mode: " << flag << "\n";
+            return 1;
+        }
+        tracing = true;
+    } else if (const char* mode = getenv("MINIGIT_TRACE"); mode && *mode && string(mode) != "0") {
+        tracing = parseTraceMode(mode, traceOptions);
+        if (!tracing) cerr << "Ignoring unknown MINIGIT_TRACE mode: " << mode << "\n";
+    }
+    if (tracing) trace::start();
+
+    if (args.empty()) {
+        cout << "Usage: ./minigit [--trace[=summary|chrome[:FILE]]] <command> [options]\n";
+        return 1;
+    }
+
+    int status = 0;
+    if (args[0] == "batch") {
+        runBatch();
+    } else if (args[0] == "daemon") {
+        status = runDaemon(args.size() >= 2 ? args[1] : ".minigit/daemon.sock");
+    } else {
+        status = runCommand(args);
+    }
+
+    if (tracing) finishTrace(traceOptions);
+    return status;
+}
@@ -0,0 +1,84 @@
+// mappedfile.h
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+// Read-only memory mapping of a whole file. Empty files map to an empty
+// view without calling mmap.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path) { open(path); }
+    ~MappedFile() { reset(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            reset();
+            bytes = other.bytes;
+            length = other.length;
+            opened = other.opened;
+            other.bytes = nullptr;
+            other.length = 0;
+            other.opened = false;
+        }
+        return *this;
+    }
+
+    bool open(const std::string &path) {
+        reset();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        trace::count(trace::FilesOpened);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            bytes = static_cast<const uint8_t*>(map);
+        }
+        ::close(fd);
+        trace::count(trace::BytesRead, length);
+        opened = true;
+        return true;
+    }
+
+    bool isOpen() const { return opened; }
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const { return {reinterpret_cast<const char*>(bytes), length}; }
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+
+    void reset() {
+        if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+        bytes = nullptr;
+        length = 0;
+        opened = false;
+    }
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,198 @@
+// materialize.h
+#ifndef MATERIALIZE_H
+#define MATERIALIZE_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include "objectstore.h"
+#include "threadpool.h"
+#include "index.h"
+#include "trace.h"
+
+// ---------------------
+// Working tree materialization
+// ---------------------
+// Writes blobs out to working-tree paths on a worker pool. Loose objects
+// stored verbatim are copied without passing through userspace: a reflink
+// (FICLONE) where the filesystem shares extents, copy_file_range otherwise,
+// and a plain read/write loop when neither is available. Deflated and
+// packed objects have to be decoded, so they always take the buffered path.
+enum class CopyMethod { None, Clone, CopyRange, Buffered };
+
+struct MaterializeResult {
+    bool ok = false;
+    CopyMethod method = CopyMethod::None;
+    std::string error;    // set when ok is false
+    FileStat stat;        // of the written file, for the index
+};
+
+namespace materialize_detail {
+
+inline bool writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        trace::count(trace::BytesWritten, static_cast<uint64_t>(n));
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool cloneFile(int in, int out) {
+#ifdef FICLONE
+    return ::ioctl(out, FICLONE, in) == 0;
+#else
+    (void)in;
+    (void)out;
+    return false;
+#endif
+}
+
+// Copies [offset, end of file) in the kernel. Returns false with nothing
+// written if copy_file_range can't handle this pair of files.
+inline bool copyRange(int in, int out, uint64_t offset, bool &failedMidway) {
+    struct stat st;
+    if (fstat(in, &st) != 0) return false;
+    loff_t from = static_cast<loff_t>(offset);
+    uint64_t remaining = static_cast<uint64_t>(st.st_size) > offset ? st.st_size - offset : 0;
+    bool copiedAny = false;
+    while (remaining > 0) {
+        ssize_t n = ::copy_file_range(in, &from, out, nullptr, remaining, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            failedMidway = copiedAny;
+            return false;
+        }
+        copiedAny = true;
+        trace::count(trace::BytesWritten, static_cast<uint64_t>(n));
+        remaining -= static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+inline bool copyBuffered(int in, int out, uint64_t offset) {
+    std::vector<char> buf(ObjectStore::CHUNK_SIZE);
+    off_t at = static_cast<off_t>(offset);
+    for (;;) {
+        ssize_t n = ::pread(in, buf.data(), buf.size(), at);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        trace::count(trace::BytesRead, static_cast<uint64_t>(n));
+        if (!writeAll(out, buf.data(), static_cast<size_t>(n))) return false;
+        at += n;
+    }
+}
+
+inline bool copyDecoded(std::istream &in, int out) {
+    std::vector<char> buf(ObjectStore::CHUNK_SIZE);
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+        if (!writeAll(out, buf.data(), static_cast<size_t>(in.gcount()))) return false;
+    }
+    return !in.bad();
+}
+
+inline MaterializeResult materializeOne(const ObjectStore &store, const std::string &path, const std::string &hash) {
+    MaterializeResult result;
+    auto fail = [&](const std::string &what) {
+        result.error = what;
+        return result;
+    };
+
+    uint64_t offset = 0;
+    std::string source = store.findVerbatim(hash, offset);
+    std::unique_ptr<std::istream> decoded;
+    if (source.empty()) {
+        decoded = store.open(hash);
+        if (!decoded) return fail("missing blob " + hash);
+    }
+
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out < 0) return fail(std::strerror(errno));
+    trace::count(trace::FilesOpened);
+
+    bool ok = false;
+    if (decoded) {
+        ok = copyDecoded(*decoded, out);
+        result.method = CopyMethod::Buffered;
+    } else {
+        int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            int err = errno;
+            ::close(out);
+            return fail(std::strerror(err));
+        }
+        trace::count(trace::FilesOpened);
+        bool failedMidway = false;
+        if (offset == 0 && cloneFile(in, out)) {
+            ok = true;
+            result.method = CopyMethod::Clone;
+        } else if (copyRange(in, out, offset, failedMidway)) {
+            ok = true;
+            result.method = CopyMethod::CopyRange;
+        } else if (!failedMidway) {
+            ok = copyBuffered(in, out, offset);
+            result.method = CopyMethod::Buffered;
+        }
+        ::close(in);
+    }
+
+    int err = ok ? 0 : errno;
+    if (::close(out) != 0 && ok) {
+        ok = false;
+        err = errno;
+    }
+    if (!ok) return fail(err ? std::strerror(err) : "could not read blob " + hash);
+
+    statFile(path, result.stat);
+    result.ok = true;
+    return result;
+}
+
+} // namespace materialize_detail
+
+// Writes each (path, blob hash) pair into the working tree, creating parent
+// directories as needed. results[i] reports on files[i]; one file failing
+// never stops the others.
+inline std::vector<MaterializeResult> materializeBlobs(const ObjectStore &store,
+                                                       const std::vector<std::pair<std::string, std::string>> &files,
+                                                       ThreadPool &pool) {
+    trace::Span span("materialize");
+    // Directories are created up front, so workers never race on them
+    std::set<std::filesystem::path> parents;
+    for (const auto &file : files) {
+        std::filesystem::path parent = std::filesystem::path(file.first).parent_path();
+        if (!parent.empty()) parents.insert(parent);
+    }
+    for (const auto &parent : parents) {
+        std::error_code ec;
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    std::vector<MaterializeResult> results(files.size());
+    pool.parallelFor(files.size(), [&](size_t i) {
+        try {
+            results[i] = materialize_detail::materializeOne(store, files[i].first, files[i].second);
+        } catch (const std::exception &e) {
+            results[i].ok = false;
+            results[i].error = e.what();
+        }
+    });
+    return results;
+}
+
+#endif // MATERIALIZE_H
@@ -0,0 +1,150 @@
+// merge.h
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include "diff.h"
+
+// ---------------------
+// Three-way line merge
+// ---------------------
+// diff3-style merge of two descendants ("ours", "theirs") of a common base.
+// Both sides are diffed against the base; regions only one side touched
+// take that side, regions both sides changed identically take either, and
+// only regions with different changes on each side become conflicts:
+//
+//   <<<<<<< ours-label
+//   ours lines
+//   ||||||| base
+//   base lines
+//   =======
+//   theirs lines
+//   >>>>>>> theirs-label
+//
+// The merge streams: the first pass reduces each version to line IDs, the
+// second re-opens all three and copies lines straight to the output, so
+// no version is ever held as text in memory.
+namespace merge_detail {
+
+// Maps each base line to its line on the other side, or -1 if removed
+inline std::vector<int> matchBase(const DiffResult &result) {
+    std::vector<int> match(result.deleted.size(), -1);
+    size_t other = 0;
+    for (size_t i = 0; i < result.deleted.size(); ++i) {
+        while (other < result.inserted.size() && result.inserted[other]) ++other;
+        if (!result.deleted[i]) match[i] = static_cast<int>(other++);
+    }
+    return match;
+}
+
+class LineCursor {
+public:
+    explicit LineCursor(std::unique_ptr<std::istream> in) : in(std::move(in)) {}
+
+    void copy(int count, std::ostream &out) {
+        for (int i = 0; i < count && next(); ++i) out << line << "\n";
+    }
+
+    void skip(int count) {
+        for (int i = 0; i < count && next(); ++i) {}
+    }
+
+private:
+    std::unique_ptr<std::istream> in;
+    std::string line;
+
+    bool next() { return in && std::getline(*in, line); }
+};
+
+} // namespace merge_detail
+
+using StreamOpener = std::function<std::unique_ptr<std::istream>()>;
+
+// Writes the merged result to `out` and returns the number of conflicting
+// regions. An opener may return nullptr for a side that has no content.
+inline size_t mergeLines(const StreamOpener &openBase, const StreamOpener &openOurs, const StreamOpener &openTheirs,
+                         std::ostream &out, const std::string &oursLabel, const std::string &theirsLabel) {
+    using namespace merge_detail;
+
+    HashedLineInterner interner;
+    auto intern = [&](const StreamOpener &open) {
+        auto in = open();
+        return in ? interner.internStream(*in) : std::vector<uint32_t>();
+    };
+    std::vector<uint32_t> base = intern(openBase), ours = intern(openOurs), theirs = intern(openTheirs);
+
+    std::vector<int> matchOurs = matchBase(diffLines(base, ours, DiffAlgorithm::Histogram));
+    std::vector<int> matchTheirs = matchBase(diffLines(base, theirs, DiffAlgorithm::Histogram));
+
+    LineCursor baseIn(openBase()), oursIn(openOurs()), theirsIn(openTheirs());
+    const int nBase = static_cast<int>(base.size());
+    const int nOurs = static_cast<int>(ours.size()), nTheirs = static_cast<int>(theirs.size());
+    int o = 0, a = 0, b = 0;
+    size_t conflicts = 0;
+
+    // Does [from, from + length) of one side equal the same range of base?
+    auto unchanged = [&](const std::vector<int> &match, int oEnd, int from, int length) {
+        if (length != oEnd - o) return false;
+        for (int k = o; k < oEnd; ++k)
+            if (match[k] != from + (k - o)) return false;
+        return true;
+    };
+
+    for (;;) {
+        // Stable run: lines every version still shares
+        int stable = 0;
+        while (o + stable < nBase && matchOurs[o + stable] == a + stable && matchTheirs[o + stable] == b + stable)
+            ++stable;
+        if (stable > 0) {
+            oursIn.copy(stable, out);
+            baseIn.skip(stable);
+            theirsIn.skip(stable);
+            o += stable;
+            a += stable;
+            b += stable;
+        }
+        if (o == nBase && a == nOurs && b == nTheirs) break;
+
+        // Unstable chunk, up to the next base line both sides kept
+        int oEnd = o;
+        while (oEnd < nBase && (matchOurs[oEnd] < 0 || matchTheirs[oEnd] < 0)) ++oEnd;
+        int aEnd = oEnd < nBase ? matchOurs[oEnd] : nOurs;
+        int bEnd = oEnd < nBase ? matchTheirs[oEnd] : nTheirs;
+        int oLen = oEnd - o, aLen = aEnd - a, bLen = bEnd - b;
+
+        bool oursSame = unchanged(matchOurs, oEnd, a, aLen);
+        bool theirsSame = unchanged(matchTheirs, oEnd, b, bLen);
+        bool sidesEqual = aLen == bLen && std::equal(ours.begin() + a, ours.begin() + aEnd, theirs.begin() + b);
+
+        if (oursSame || sidesEqual) {
+            theirsIn.copy(bLen, out);
+            baseIn.skip(oLen);
+            oursIn.skip(aLen);
+        } else if (theirsSame) {
+            oursIn.copy(aLen, out);
+            baseIn.skip(oLen);
+            theirsIn.skip(bLen);
+        } else {
+            ++conflicts;
+            out << "<<<<<<< " << oursLabel << "\n";
+            oursIn.copy(aLen, out);
+            out << "||||||| base\n";
+            baseIn.copy(oLen, out);
+            out << "=======\n";
+            theirsIn.copy(bLen, out);
+            out << ">>>>>>> " << theirsLabel << "\n";
+        }
+        o = oEnd;
+        a = aEnd;
+        b = bEnd;
+    }
+    return conflicts;
+}
+
+#endif // MERGE_H
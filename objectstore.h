@@ -0,0 +1,670 @@
+// objectstore.h
+#ifndef OBJECTSTORE_H
+#define OBJECTSTORE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include <streambuf>
+#include <istream>
+#include <stdexcept>
+#include <cstring>
+#include <unistd.h>
+#include <zlib.h>
+#include <memory>
+#include <sstream>
+#include "sha1.h"
+#include "pack.h"
+#include "chunker.h"
+#include "trace.h"
+
+// ---------------------
+// Object encoding
+// ---------------------
+// Objects are stored either plain (the raw blob bytes, as older builds
+// wrote them) or behind a 5-byte header: "\0MGZ" followed by a format
+// byte, 'z' for a zlib stream or 's' for stored bytes. Working-tree files
+// practically never start with NUL, so the header can't be mistaken for
+// plain content; blobs that do start with the magic are written 's'.
+//
+// 'c' marks a chunked blob: the header is followed by a chunk list, one
+// "<chunk hash> <length>\n" line per chunk in file order, and the blob's
+// bytes are those chunks concatenated. Chunks are ordinary objects.
+namespace object_format {
+
+const char MAGIC[4] = {'\0', 'M', 'G', 'Z'};
+const size_t HEADER_SIZE = 5;
+const char ZLIB = 'z';
+const char STORED = 's';
+const char CHUNKED = 'c';
+
+inline bool startsWithMagic(const char *data, size_t len) {
+    return len >= 4 && std::memcmp(data, MAGIC, 4) == 0;
+}
+
+} // namespace object_format
+
+// Streams blob bytes into an object file. The first chunk decides the
+// encoding: if a trial deflate of it saves less than 10%, the object is
+// written plain so incompressible data costs nothing extra on either side.
+class ObjectWriter {
+public:
+    ObjectWriter(std::ostream &out, int level) : out(out), level(level) {}
+
+    ~ObjectWriter() {
+        if (deflating) deflateEnd(&zs);
+    }
+
+    ObjectWriter(const ObjectWriter&) = delete;
+    ObjectWriter& operator=(const ObjectWriter&) = delete;
+
+    bool write(const char *data, size_t len) {
+        if (!chosen) choose(data, len);
+        if (!deflating) {
+            out.write(data, static_cast<std::streamsize>(len));
+            trace::count(trace::BytesWritten, len);
+            return out.good();
+        }
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zs.avail_in = static_cast<uInt>(len);
+        return pump(Z_NO_FLUSH);
+    }
+
+    bool finish() {
+        if (!chosen) choose(nullptr, 0);
+        if (deflating && !pump(Z_FINISH)) return false;
+        out.flush();
+        return out.good();
+    }
+
+private:
+    std::ostream &out;
+    int level;
+    bool chosen = false;
+    bool deflating = false;
+    z_stream zs{};
+    char outBuf[1 << 16];
+
+    void choose(const char *data, size_t len) {
+        chosen = true;
+        bool compress = false;
+        if (level > 0 && len > 0) {
+            std::vector<Bytef> probe(compressBound(static_cast<uLong>(len)));
+            uLongf probeLen = static_cast<uLongf>(probe.size());
+            if (compress2(probe.data(), &probeLen, reinterpret_cast<const Bytef*>(data),
+                          static_cast<uLong>(len), level) == Z_OK) {
+                compress = probeLen < len - len / 10;
+            }
+        }
+
+        if (compress && deflateInit(&zs, level) == Z_OK) {
+            deflating = true;
+            out.write(object_format::MAGIC, 4);
+            out.put(object_format::ZLIB);
+        } else if (object_format::startsWithMagic(data, len)) {
+            out.write(object_format::MAGIC, 4);
+            out.put(object_format::STORED);
+        }
+    }
+
+    bool pump(int flush) {
+        for (;;) {
+            zs.next_out = reinterpret_cast<Bytef*>(outBuf);
+            zs.avail_out = sizeof(outBuf);
+            int rc = deflate(&zs, flush);
+            if (rc == Z_STREAM_ERROR) return false;
+            out.write(outBuf, static_cast<std::streamsize>(sizeof(outBuf) - zs.avail_out));
+            trace::count(trace::BytesWritten, sizeof(outBuf) - zs.avail_out);
+            if (!out.good()) return false;
+            if (flush == Z_FINISH ? rc == Z_STREAM_END : zs.avail_out != 0) return true;
+        }
+    }
+};
+
+// Streambuf that yields an object's blob bytes, inflating on the fly, so
+// callers can getline() or rdbuf()-copy a blob without loading it whole.
+class ObjectReadBuf : public std::streambuf {
+public:
+    explicit ObjectReadBuf(const std::string &path) : file(path, std::ios::binary) {
+        if (!file.is_open()) return;
+        trace::count(trace::FilesOpened);
+
+        char header[object_format::HEADER_SIZE];
+        file.read(header, sizeof(header));
+        size_t got = static_cast<size_t>(file.gcount());
+        trace::count(trace::BytesRead, got);
+
+        if (got == sizeof(header) && object_format::startsWithMagic(header, got) &&
+            (header[4] == object_format::ZLIB || header[4] == object_format::STORED ||
+             header[4] == object_format::CHUNKED)) {
+            chunkList = header[4] == object_format::CHUNKED;
+            if (header[4] == object_format::ZLIB) {
+                if (inflateInit(&zs) != Z_OK) throw std::runtime_error("inflateInit failed");
+                inflating = true;
+            }
+        } else {
+            // Plain object: the bytes read so far are content
+            std::memcpy(outBuf, header, got);
+            setg(outBuf, outBuf, outBuf + got);
+        }
+    }
+
+    ~ObjectReadBuf() override {
+        if (inflating) inflateEnd(&zs);
+    }
+
+    bool isOpen() const { return file.is_open(); }
+
+    // True if the object is a chunked blob and this yields its chunk list
+    bool isChunkList() const { return chunkList; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (finished || !file.is_open()) return traits_type::eof();
+
+        if (!inflating) {
+            file.read(outBuf, sizeof(outBuf));
+            std::streamsize got = file.gcount();
+            trace::count(trace::BytesRead, static_cast<uint64_t>(std::max<std::streamsize>(got, 0)));
+            if (got <= 0) {
+                finished = true;
+                return traits_type::eof();
+            }
+            setg(outBuf, outBuf, outBuf + got);
+            return traits_type::to_int_type(*gptr());
+        }
+
+        for (;;) {
+            if (zs.avail_in == 0) {
+                file.read(inBuf, sizeof(inBuf));
+                zs.next_in = reinterpret_cast<Bytef*>(inBuf);
+                zs.avail_in = static_cast<uInt>(file.gcount());
+                trace::count(trace::BytesRead, zs.avail_in);
+                if (zs.avail_in == 0) throw std::runtime_error("truncated object");
+            }
+            zs.next_out = reinterpret_cast<Bytef*>(outBuf);
+            zs.avail_out = sizeof(outBuf);
+            int rc = inflate(&zs, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END) throw std::runtime_error("corrupt object");
+
+            size_t produced = sizeof(outBuf) - zs.avail_out;
+            if (rc == Z_STREAM_END) finished = true;
+            if (produced > 0) {
+                setg(outBuf, outBuf, outBuf + produced);
+                return traits_type::to_int_type(*gptr());
+            }
+            if (finished) return traits_type::eof();
+        }
+    }
+
+private:
+    std::ifstream file;
+    bool inflating = false;
+    bool chunkList = false;
+    bool finished = false;
+    z_stream zs{};
+    char inBuf[1 << 16];
+    char outBuf[1 << 16];
+};
+
+// istream over an object's blob bytes: ObjectStream in(store.find(hash));
+// For a chunked blob it yields the chunk list; ObjectStore::open follows it.
+class ObjectStream : public std::istream {
+public:
+    explicit ObjectStream(const std::string &path) : std::istream(nullptr), buf(path) {
+        rdbuf(&buf);
+        if (!buf.isOpen()) setstate(std::ios::failbit);
+    }
+
+    bool is_open() const { return buf.isOpen(); }
+    bool isChunkList() const { return buf.isChunkList(); }
+
+private:
+    ObjectReadBuf buf;
+};
+
+// ---------------------
+// Loose object store
+// ---------------------
+// Blobs live, compressed where it pays off, under a two-level fan-out,
+// objects/ab/cdef..., so no single directory grows past 1/256th of the
+// store. Every write goes to a temp file inside objects/ and is renamed
+// into place, so a reader never sees a partially written object and an
+// interrupted write leaves only a tmp_* file behind.
+//
+// `repack` moves loose objects into objects/pack/. Lookups consult the pack
+// indexes first and then the loose layout, so readers never need to know
+// where an object lives.
+//
+// Repos created before the fan-out still have flat objects/<hash> files.
+// Stores without the objects/.fanout marker fall back to that path on a
+// miss until `migrate-objects` has moved them and written the marker.
+//
+// Files of CHUNKED_THRESHOLD bytes or more are stored chunked (see
+// chunker.h): each content-defined chunk is its own object and the blob is
+// a chunk list. The blob hash is still the SHA-1 of the whole file, so
+// trees, the index and status don't care how a blob is stored, but a new
+// version of a large file only writes the chunks the edit touched.
+class ObjectStore {
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+    static constexpr uint64_t PACK_SIZE_LIMIT = 32ULL << 20;
+    static constexpr uint64_t CHUNKED_THRESHOLD = 8ULL << 20;
+
+    explicit ObjectStore(std::string objectsDir) : dir(std::move(objectsDir)) {
+        std::error_code ec;
+        legacyFallback = !std::filesystem::exists(dir + "/.fanout", ec);
+        loadPacks();
+    }
+
+    const std::string &directory() const { return dir; }
+
+    // zlib level for new objects; 0 writes every object plain
+    void setCompressionLevel(int level) { compressionLevel = level; }
+
+    // Size from which storeFile chunks a file; UINT64_MAX never chunks
+    void setChunkThreshold(uint64_t bytes) { chunkThreshold = bytes; }
+
+    // Creates an empty store that uses the fan-out layout only
+    bool initialize() {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        std::ofstream marker(dir + "/.fanout");
+        if (!marker.good()) return false;
+        legacyFallback = false;
+        return true;
+    }
+
+    std::string pathFor(const std::string &hash) const {
+        return dir + "/" + hash.substr(0, 2) + "/" + hash.substr(2);
+    }
+
+    // Path of an existing loose object, or "" if it isn't stored loose
+    std::string find(const std::string &hash) const {
+        if (hash.size() < 3) return "";
+        std::error_code ec;
+        std::string path = pathFor(hash);
+        if (std::filesystem::is_regular_file(path, ec)) return path;
+        if (!legacyFallback) return "";
+        std::string legacy = dir + "/" + hash;
+        if (std::filesystem::is_regular_file(legacy, ec)) return legacy;
+        return "";
+    }
+
+    bool contains(const std::string &hash) const {
+        trace::count(trace::ObjectLookups);
+        const PackFile *pack;
+        uint64_t offset;
+        return findPacked(hash, pack, offset) || !find(hash).empty();
+    }
+
+    bool findPacked(const std::string &hash, const PackFile *&pack, uint64_t &offset) const {
+        for (const auto &candidate : packs) {
+            if (candidate->find(hash, offset)) {
+                pack = candidate.get();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Opens an object for reading wherever it lives. Loose objects stream;
+    // packed ones are rebuilt from their delta chain in memory (repack
+    // leaves anything larger than PACK_SIZE_LIMIT loose). Returns nullptr
+    // if the object doesn't exist.
+    std::unique_ptr<std::istream> open(const std::string &hash) const {
+        trace::count(trace::ObjectLookups);
+        const PackFile *pack;
+        uint64_t offset;
+        if (findPacked(hash, pack, offset)) {
+            std::string content;
+            if (!pack->read(offset, content)) return nullptr;
+            return std::make_unique<std::istringstream>(std::move(content));
+        }
+        std::string path = find(hash);
+        if (path.empty()) return nullptr;
+        return openLoose(path);
+    }
+
+    // Path of a loose object whose file holds the blob bytes verbatim from
+    // `contentOffset` on (plain or stored, not deflated), so it can be
+    // cloned or copied into the working tree without decoding. Returns ""
+    // for packed, deflated and missing objects.
+    std::string findVerbatim(const std::string &hash, uint64_t &contentOffset) const {
+        trace::count(trace::ObjectLookups);
+        const PackFile *pack;
+        uint64_t offset;
+        if (findPacked(hash, pack, offset)) return "";
+        std::string path = find(hash);
+        if (path.empty()) return "";
+
+        char format = looseFormat(path);
+        if (format == object_format::ZLIB || format == object_format::CHUNKED) return "";
+        contentOffset = format == object_format::STORED ? object_format::HEADER_SIZE : 0;
+        return path;
+    }
+
+    // True if the object is stored loose as a chunk list
+    bool isChunked(const std::string &hash) const {
+        std::string path = find(hash);
+        return !path.empty() && looseFormat(path) == object_format::CHUNKED;
+    }
+
+    // Reads a whole object into memory
+    bool readAll(const std::string &hash, std::string &content) const {
+        trace::count(trace::ObjectLookups);
+        const PackFile *pack;
+        uint64_t offset;
+        if (findPacked(hash, pack, offset)) return pack->read(offset, content);
+
+        std::string path = find(hash);
+        if (path.empty()) return false;
+        auto in = openLoose(path);
+        if (!in) return false;
+        std::ostringstream buffer;
+        buffer << in->rdbuf();
+        content = buffer.str();
+        return !in->bad();
+    }
+
+    std::string packDirectory() const { return dir + "/pack"; }
+    const std::vector<std::shared_ptr<PackFile>> &packFiles() const { return packs; }
+
+    // Re-scans objects/pack/, e.g. after repack wrote a new pack
+    void loadPacks() {
+        packs.clear();
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(packDirectory(), ec)) {
+            if (entry.path().extension() != ".idx") continue;
+            std::filesystem::path packPath = entry.path();
+            packPath.replace_extension(".pack");
+            if (auto pack = PackFile::open(packPath.string(), entry.path().string())) packs.push_back(pack);
+        }
+    }
+
+    // Unique scratch name inside objects/ so rename() stays on one filesystem
+    std::string tempPath() const {
+        static std::atomic<unsigned long> counter{0};
+        return dir + "/tmp_" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+    }
+
+    // Moves a fully written temp file into place under `hash`. If the object
+    // already exists the temp file is dropped instead.
+    bool install(const std::string &tempFile, const std::string &hash) const {
+        std::error_code ec;
+        if (contains(hash)) {
+            std::filesystem::remove(tempFile, ec);
+            return true;
+        }
+
+        std::string path = pathFor(hash);
+        std::filesystem::create_directory(dir + "/" + hash.substr(0, 2), ec);
+        std::filesystem::rename(tempFile, path, ec);
+        if (ec) {
+            std::filesystem::remove(tempFile, ec);
+            return false;
+        }
+        return true;
+    }
+
+    // Writes an in-memory blob. Returns its hash, or "" on failure.
+    std::string store(const std::string &content) const {
+        return storeBytes(content.data(), content.size());
+    }
+
+    // Streams a file through SHA-1 in fixed-size chunks while compressing
+    // the same bytes into a temp object, so memory use is one chunk
+    // regardless of file size. Returns the blob hash, or "" on I/O failure.
+    std::string storeFile(const std::string &filename) const {
+        std::ifstream inFile(filename, std::ios::binary);
+        if (!inFile.is_open()) return "";
+
+        std::error_code ec;
+        if (std::filesystem::file_size(filename, ec) >= chunkThreshold && !ec) return storeChunked(inFile);
+
+        std::string temp = tempPath();
+        std::ofstream tempFile(temp, std::ios::binary | std::ios::trunc);
+        if (!tempFile.is_open()) return "";
+        trace::count(trace::FilesOpened, 2);
+
+        SHA1 sha;
+        ObjectWriter writer(tempFile, compressionLevel);
+        std::vector<char> chunk(CHUNK_SIZE);
+        bool ok = true;
+        while (ok && (inFile.read(chunk.data(), chunk.size()) || inFile.gcount() > 0)) {
+            size_t got = static_cast<size_t>(inFile.gcount());
+            trace::count(trace::BytesRead, got);
+            sha.update(reinterpret_cast<const uint8_t*>(chunk.data()), got);
+            ok = writer.write(chunk.data(), got);
+        }
+        ok = ok && writer.finish() && !inFile.bad();
+        tempFile.close();
+
+        if (!ok || tempFile.fail()) {
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            return "";
+        }
+
+        std::string hash = sha.final();
+        return install(temp, hash) ? hash : "";
+    }
+
+    // Moves flat objects/<hash> files into the fan-out layout. Returns the
+    // number of objects moved, or -1 if any move failed.
+    long migrateFlat() {
+        std::vector<std::filesystem::path> flat;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (entry.is_regular_file() && isHash(name)) flat.push_back(entry.path());
+        }
+
+        long moved = 0;
+        bool failed = false;
+        for (const auto &path : flat) {
+            std::string hash = path.filename().string();
+            std::filesystem::create_directory(dir + "/" + hash.substr(0, 2), ec);
+            std::filesystem::rename(path, pathFor(hash), ec);
+            if (ec) failed = true;
+            else ++moved;
+        }
+        if (failed || !initialize()) return -1;
+        return moved;
+    }
+
+    // Hashes of every loose object, in either layout
+    std::vector<std::string> looseObjects() const {
+        std::vector<std::string> hashes;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (entry.is_regular_file() && isHash(name)) {
+                hashes.push_back(name);
+                continue;
+            }
+            if (!entry.is_directory() || name.size() != 2) continue;
+            for (const auto &object : std::filesystem::directory_iterator(entry.path(), ec)) {
+                std::string hash = name + object.path().filename().string();
+                if (isHash(hash)) hashes.push_back(hash);
+            }
+        }
+        return hashes;
+    }
+
+    // Deletes a loose object, and its fan-out directory once that is empty
+    void removeLoose(const std::string &hash) const {
+        std::string path = find(hash);
+        if (path.empty()) return;
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (parent != std::filesystem::path(dir)) std::filesystem::remove(parent, ec);
+    }
+
+    static bool isHash(const std::string &name) {
+        if (name.size() != 40) return false;
+        for (char c : name) {
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+        }
+        return true;
+    }
+
+private:
+    std::string dir;
+    bool legacyFallback = true;
+    int compressionLevel = Z_BEST_SPEED;
+    uint64_t chunkThreshold = CHUNKED_THRESHOLD;
+    std::vector<std::shared_ptr<PackFile>> packs;
+
+    // Format byte of a loose object's header, or 0 for a plain object
+    static char looseFormat(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        trace::count(trace::FilesOpened);
+        char header[object_format::HEADER_SIZE];
+        in.read(header, sizeof(header));
+        trace::count(trace::BytesRead, static_cast<uint64_t>(in.gcount()));
+        bool tagged = static_cast<size_t>(in.gcount()) == sizeof(header) &&
+                      object_format::startsWithMagic(header, sizeof(header));
+        return tagged ? header[4] : 0;
+    }
+
+    std::unique_ptr<std::istream> openLoose(const std::string &path) const;
+
+    std::string storeBytes(const char *data, size_t len) const {
+        SHA1 sha;
+        sha.update(reinterpret_cast<const uint8_t*>(data), len);
+        std::string hash = sha.final();
+        if (contains(hash)) return hash;
+
+        std::string temp = tempPath();
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        trace::count(trace::FilesOpened);
+        ObjectWriter writer(out, compressionLevel);
+        bool ok = writer.write(data, len) && writer.finish();
+        out.close();
+        if (!ok || out.fail()) {
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            return "";
+        }
+        return install(temp, hash) ? hash : "";
+    }
+
+    // Cuts the file into content-defined chunks as it streams in, stores
+    // each chunk it doesn't already have, and installs the chunk list
+    // under the hash of the whole file. Holds at most 2 * cdc::MAX_SIZE.
+    std::string storeChunked(std::ifstream &inFile) const {
+        SHA1 whole;
+        std::string list;
+        std::vector<char> buf(2 * cdc::MAX_SIZE);
+        size_t start = 0, end = 0;
+        bool eof = false;
+
+        for (;;) {
+            if (!eof && end - start < cdc::MAX_SIZE) {
+                std::memmove(buf.data(), buf.data() + start, end - start);
+                end -= start;
+                start = 0;
+                inFile.read(buf.data() + end, static_cast<std::streamsize>(buf.size() - end));
+                size_t got = static_cast<size_t>(inFile.gcount());
+                if (inFile.bad()) return "";
+                trace::count(trace::BytesRead, got);
+                whole.update(reinterpret_cast<const uint8_t*>(buf.data() + end), got);
+                end += got;
+                eof = !inFile;
+            }
+            if (start == end) break;
+
+            size_t len = cdc::cut(reinterpret_cast<const uint8_t*>(buf.data() + start), end - start);
+            std::string chunk = storeBytes(buf.data() + start, len);
+            if (chunk.empty()) return "";
+            list += chunk + " " + std::to_string(len) + "\n";
+            start += len;
+        }
+
+        std::string hash = whole.final();
+        if (contains(hash)) return hash;
+
+        std::string temp = tempPath();
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            trace::count(trace::FilesOpened);
+            out.write(object_format::MAGIC, 4);
+            out.put(object_format::CHUNKED);
+            out << list;
+            trace::count(trace::BytesWritten, object_format::HEADER_SIZE + list.size());
+            out.close();
+            if (out.fail()) {
+                std::error_code ec;
+                std::filesystem::remove(temp, ec);
+                return "";
+            }
+        }
+        return install(temp, hash) ? hash : "";
+    }
+};
+
+// Streambuf over a chunked blob: opens each chunk in list order and
+// passes its bytes through, so only one chunk is open at a time.
+class ChunkedReadBuf : public std::streambuf {
+public:
+    ChunkedReadBuf(const ObjectStore &store, std::vector<std::string> chunks)
+        : store(store), chunks(std::move(chunks)) {}
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        for (;;) {
+            if (current) {
+                current->read(buf, sizeof(buf));
+                std::streamsize got = current->gcount();
+                if (got > 0) {
+                    setg(buf, buf, buf + got);
+                    return traits_type::to_int_type(*gptr());
+                }
+                if (current->bad()) throw std::runtime_error("unreadable chunk " + chunks[next - 1]);
+            }
+            if (next == chunks.size()) return traits_type::eof();
+            current = store.open(chunks[next++]);
+            if (!current) throw std::runtime_error("missing chunk " + chunks[next - 1]);
+        }
+    }
+
+private:
+    const ObjectStore &store;
+    std::vector<std::string> chunks;
+    size_t next = 0;
+    std::unique_ptr<std::istream> current;
+    char buf[1 << 16];
+};
+
+class ChunkedStream : public std::istream {
+public:
+    ChunkedStream(const ObjectStore &store, std::vector<std::string> chunks)
+        : std::istream(nullptr), buf(store, std::move(chunks)) {
+        rdbuf(&buf);
+    }
+
+private:
+    ChunkedReadBuf buf;
+};
+
+inline std::unique_ptr<std::istream> ObjectStore::openLoose(const std::string &path) const {
+    auto stream = std::make_unique<ObjectStream>(path);
+    if (!stream->isChunkList()) return stream;
+
+    std::vector<std::string> chunks;
+    std::string line;
+    while (std::getline(*stream, line)) {
+        size_t space = line.find(' ');
+        if (space != 40) return nullptr;
+        chunks.push_back(line.substr(0, space));
+    }
+    return std::make_unique<ChunkedStream>(*this, std::move(chunks));
+}
+
+#endif // OBJECTSTORE_H
@@ -0,0 +1,389 @@
+// pack.h
+#ifndef PACK_H
+#define PACK_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "sha1.h"
+#include "byteio.h"
+
+// ---------------------
+// Pack files
+// ---------------------
+// A pack holds many objects in one file, each either whole or as a delta
+// against another entry earlier in the same pack. All integers are
+// little-endian.
+//
+//   pack-<name>.pack
+//     "MGPK" | version u32 | object count u32
+//     per entry:
+//       kind u8 ('f' full, 'd' delta) | size u64 (inflated payload)
+//       [base offset u64, delta entries only] | compressed size u64 | zlib payload
+//
+//   pack-<name>.idx
+//     "MGPI" | version u32 | object count u32
+//     fan-out u32[256]       number of hashes whose first byte is <= i
+//     hashes  20 bytes[n]    sorted
+//     offsets u64[n]         entry offset in the .pack, parallel to hashes
+//
+// The fan-out table narrows a lookup to the hashes sharing a first byte and
+// a binary search finishes it, so reads never scan the pack.
+
+// ---------------------
+// Delta encoding
+// ---------------------
+// A delta is: varint base size | varint result size | ops, where each op is
+// 'c' varint offset varint length (copy from the base) or
+// 'i' varint length bytes (insert literal bytes).
+//
+// Matches are found by indexing the base at 16-byte block boundaries and
+// sliding a rolling hash over the target, then extending every verified
+// match forwards and backwards.
+namespace delta {
+
+const size_t BLOCK = 16;
+const uint64_t PRIME = 1099511628211ULL;
+
+inline std::string create(const std::string &base, const std::string &target) {
+    using namespace byteio;
+    std::string out;
+    putVarint(out, base.size());
+    putVarint(out, target.size());
+
+    std::unordered_map<uint64_t, uint32_t> blocks;
+    uint64_t topPower = 1;
+    for (size_t i = 1; i < BLOCK; ++i) topPower *= PRIME;
+    auto hashAt = [](const std::string &s, size_t at) {
+        uint64_t h = 0;
+        for (size_t i = 0; i < BLOCK; ++i) h = h * PRIME + static_cast<uint8_t>(s[at + i]);
+        return h;
+    };
+    if (base.size() >= BLOCK) {
+        blocks.reserve(base.size() / BLOCK);
+        for (size_t at = 0; at + BLOCK <= base.size(); at += BLOCK) blocks.emplace(hashAt(base, at), static_cast<uint32_t>(at));
+    }
+
+    size_t literalStart = 0;
+    auto flushLiteral = [&](size_t end) {
+        if (end > literalStart) {
+            out.push_back('i');
+            putVarint(out, end - literalStart);
+            out.append(target, literalStart, end - literalStart);
+        }
+    };
+
+    size_t pos = 0;
+    uint64_t h = 0;
+    bool hashValid = false;
+    while (pos + BLOCK <= target.size() && !blocks.empty()) {
+        if (!hashValid) {
+            h = hashAt(target, pos);
+            hashValid = true;
+        }
+
+        auto it = blocks.find(h);
+        if (it != blocks.end() && std::memcmp(base.data() + it->second, target.data() + pos, BLOCK) == 0) {
+            size_t baseStart = it->second;
+            size_t targetStart = pos;
+            size_t length = BLOCK;
+            while (baseStart + length < base.size() && targetStart + length < target.size() &&
+                   base[baseStart + length] == target[targetStart + length]) {
+                ++length;
+            }
+            while (baseStart > 0 && targetStart > literalStart && base[baseStart - 1] == target[targetStart - 1]) {
+                --baseStart;
+                --targetStart;
+                ++length;
+            }
+
+            flushLiteral(targetStart);
+            out.push_back('c');
+            putVarint(out, baseStart);
+            putVarint(out, length);
+            pos = literalStart = targetStart + length;
+            hashValid = false;
+            continue;
+        }
+
+        if (pos + BLOCK < target.size()) {
+            h = (h - static_cast<uint8_t>(target[pos]) * topPower) * PRIME + static_cast<uint8_t>(target[pos + BLOCK]);
+        }
+        ++pos;
+    }
+
+    flushLiteral(target.size());
+    return out;
+}
+
+inline bool apply(const std::string &base, const std::string &ops, std::string &result) {
+    using namespace byteio;
+    size_t pos = 0;
+    uint64_t baseSize = 0, resultSize = 0;
+    if (!getVarint(ops, pos, baseSize) || !getVarint(ops, pos, resultSize) || baseSize != base.size()) return false;
+
+    result.clear();
+    result.reserve(resultSize);
+    while (pos < ops.size()) {
+        char op = ops[pos++];
+        uint64_t a = 0, b = 0;
+        if (op == 'c') {
+            if (!getVarint(ops, pos, a) || !getVarint(ops, pos, b) || a + b > base.size()) return false;
+            result.append(base, a, b);
+        } else if (op == 'i') {
+            if (!getVarint(ops, pos, a) || pos + a > ops.size()) return false;
+            result.append(ops, pos, a);
+            pos += a;
+        } else {
+            return false;
+        }
+    }
+    return result.size() == resultSize;
+}
+
+} // namespace delta
+
+// ---------------------
+// Reading packs
+// ---------------------
+class PackFile {
+public:
+    // Maps the .idx and opens the .pack. Returns nullptr if either is unusable.
+    static std::shared_ptr<PackFile> open(const std::string &packPath, const std::string &idxPath) {
+        auto pack = std::shared_ptr<PackFile>(new PackFile());
+        pack->packFd = ::open(packPath.c_str(), O_RDONLY | O_CLOEXEC);
+        int idxFd = ::open(idxPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (pack->packFd < 0 || idxFd < 0) {
+            if (idxFd >= 0) ::close(idxFd);
+            return nullptr;
+        }
+
+        struct stat st;
+        if (fstat(idxFd, &st) != 0 || st.st_size < 12 + 256 * 4) {
+            ::close(idxFd);
+            return nullptr;
+        }
+        pack->idxSize = static_cast<size_t>(st.st_size);
+        void *map = mmap(nullptr, pack->idxSize, PROT_READ, MAP_PRIVATE, idxFd, 0);
+        ::close(idxFd);
+        if (map == MAP_FAILED) return nullptr;
+        pack->idx = static_cast<const uint8_t*>(map);
+
+        using byteio::getU32;
+        pack->objectCount = getU32(pack->idx + 8);
+        if (std::memcmp(pack->idx, "MGPI", 4) != 0 || getU32(pack->idx + 4) != 1 ||
+            pack->idxSize < 12 + 256 * 4 + static_cast<size_t>(pack->objectCount) * 28) {
+            return nullptr;
+        }
+        pack->fanout = pack->idx + 12;
+        pack->hashes = pack->fanout + 256 * 4;
+        pack->offsets = pack->hashes + static_cast<size_t>(pack->objectCount) * 20;
+        return pack;
+    }
+
+    ~PackFile() {
+        if (idx) munmap(const_cast<uint8_t*>(idx), idxSize);
+        if (packFd >= 0) ::close(packFd);
+    }
+
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    uint32_t count() const { return objectCount; }
+
+    std::string hashAt(uint32_t i) const { return hexFromRaw(hashes + static_cast<size_t>(i) * 20); }
+    uint64_t offsetAt(uint32_t i) const { return byteio::getU64(offsets + static_cast<size_t>(i) * 8); }
+
+    bool find(const std::string &hash, uint64_t &offset) const {
+        uint8_t raw[20];
+        rawFromHex(hash, raw);
+        using byteio::getU32;
+        uint32_t lo = raw[0] == 0 ? 0 : getU32(fanout + (raw[0] - 1) * 4);
+        uint32_t hi = getU32(fanout + raw[0] * 4);
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = std::memcmp(hashes + static_cast<size_t>(mid) * 20, raw, 20);
+            if (cmp == 0) {
+                offset = offsetAt(mid);
+                return true;
+            }
+            if (cmp < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return false;
+    }
+
+    // Reconstructs the object at `offset`, following its delta chain
+    bool read(uint64_t offset, std::string &out, int depth = 0) const {
+        using namespace byteio;
+        if (depth > MAX_CHAIN) return false;
+
+        uint8_t header[33];
+        ssize_t got = pread(packFd, header, sizeof(header), static_cast<off_t>(offset));
+        if (got < 17) return false;
+
+        char kind = static_cast<char>(header[0]);
+        uint64_t size = getU64(header + 1);
+        uint64_t baseOffset = 0;
+        size_t at = 9;
+        if (kind == 'd') {
+            if (got < 25) return false;
+            baseOffset = getU64(header + at);
+            at += 8;
+        } else if (kind != 'f') {
+            return false;
+        }
+        uint64_t compressedSize = getU64(header + at);
+        at += 8;
+
+        std::string compressed(compressedSize, '\0');
+        if (pread(packFd, &compressed[0], compressedSize, static_cast<off_t>(offset + at)) != static_cast<ssize_t>(compressedSize)) {
+            return false;
+        }
+        std::string payload(size, '\0');
+        uLongf payloadLen = static_cast<uLongf>(size);
+        if (uncompress(reinterpret_cast<Bytef*>(&payload[0]), &payloadLen,
+                       reinterpret_cast<const Bytef*>(compressed.data()), compressedSize) != Z_OK ||
+            payloadLen != size) {
+            return false;
+        }
+
+        if (kind == 'f') {
+            out = std::move(payload);
+            return true;
+        }
+
+        std::string base;
+        return read(baseOffset, base, depth + 1) && delta::apply(base, payload, out);
+    }
+
+    static const int MAX_CHAIN = 50;
+
+private:
+    PackFile() = default;
+
+    int packFd = -1;
+    const uint8_t *idx = nullptr;
+    size_t idxSize = 0;
+    uint32_t objectCount = 0;
+    const uint8_t *fanout = nullptr;
+    const uint8_t *hashes = nullptr;
+    const uint8_t *offsets = nullptr;
+};
+
+// ---------------------
+// Writing packs
+// ---------------------
+class PackWriter {
+public:
+    explicit PackWriter(std::string tempPath) : tempPath(std::move(tempPath)), out(this->tempPath, std::ios::binary | std::ios::trunc) {
+        std::string header = "MGPK";
+        byteio::putU32(header, 1);
+        byteio::putU32(header, 0);   // count, patched in finish()
+        out.write(header.data(), header.size());
+        position = header.size();
+    }
+
+    bool good() const { return out.good(); }
+
+    uint64_t addFull(const std::string &hash, const std::string &content) {
+        return addEntry(hash, 'f', 0, content);
+    }
+
+    uint64_t addDelta(const std::string &hash, uint64_t baseOffset, const std::string &ops) {
+        return addEntry(hash, 'd', baseOffset, ops);
+    }
+
+    // Writes the .idx and renames both files to pack-<name> inside packDir.
+    // The .idx is renamed last, so readers never find an index without its pack.
+    bool finish(const std::string &packDir, std::string &packName) {
+        using namespace byteio;
+        std::string count;
+        putU32(count, static_cast<uint32_t>(entries.size()));
+        out.seekp(8);
+        out.write(count.data(), 4);
+        out.close();
+        if (out.fail()) return false;
+
+        std::sort(entries.begin(), entries.end());
+
+        SHA1 nameHash;
+        std::string idx = "MGPI";
+        putU32(idx, 1);
+        putU32(idx, static_cast<uint32_t>(entries.size()));
+        uint32_t cumulative = 0;
+        size_t next = 0;
+        for (int b = 0; b < 256; ++b) {
+            while (next < entries.size() && entries[next].first[0] == b) {
+                ++cumulative;
+                ++next;
+            }
+            putU32(idx, cumulative);
+        }
+        for (const auto &[raw, offset] : entries) {
+            idx.append(reinterpret_cast<const char*>(raw.data()), 20);
+            nameHash.update(raw.data(), 20);
+        }
+        for (const auto &[raw, offset] : entries) putU64(idx, offset);
+
+        packName = "pack-" + nameHash.final();
+        std::string idxTemp = tempPath + ".idx";
+        std::ofstream idxOut(idxTemp, std::ios::binary | std::ios::trunc);
+        idxOut.write(idx.data(), idx.size());
+        idxOut.close();
+
+        std::string base = packDir + "/" + packName;
+        if (idxOut.fail() || std::rename(tempPath.c_str(), (base + ".pack").c_str()) != 0 ||
+            std::rename(idxTemp.c_str(), (base + ".idx").c_str()) != 0) {
+            std::remove(idxTemp.c_str());
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t bytesWritten() const { return position; }
+
+private:
+    std::string tempPath;
+    std::ofstream out;
+    uint64_t position = 0;
+    std::vector<std::pair<std::array<uint8_t, 20>, uint64_t>> entries;
+
+    uint64_t addEntry(const std::string &hash, char kind, uint64_t baseOffset, const std::string &payload) {
+        using namespace byteio;
+        std::string compressed(compressBound(payload.size()), '\0');
+        uLongf compressedLen = static_cast<uLongf>(compressed.size());
+        compress2(reinterpret_cast<Bytef*>(&compressed[0]), &compressedLen,
+                  reinterpret_cast<const Bytef*>(payload.data()), payload.size(), Z_DEFAULT_COMPRESSION);
+
+        std::string header(1, kind);
+        putU64(header, payload.size());
+        if (kind == 'd') putU64(header, baseOffset);
+        putU64(header, compressedLen);
+
+        uint64_t offset = position;
+        out.write(header.data(), header.size());
+        out.write(compressed.data(), compressedLen);
+        position += header.size() + compressedLen;
+
+        std::array<uint8_t, 20> raw;
+        rawFromHex(hash, raw.data());
+        entries.emplace_back(raw, offset);
+        return offset;
+    }
+};
+
+#endif // PACK_H
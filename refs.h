@@ -0,0 +1,101 @@
+// refs.h
+#ifndef REFS_H
+#define REFS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "mappedfile.h"
+#include "lockfile.h"
+#include "trace.h"
+
+// ---------------------
+// Packed refs
+// ---------------------
+// .minigit/packed-refs holds many branches in one file, sorted by name:
+//
+//   # minigit packed-refs
+//   <40-char commit hash> <branch name>
+//
+// Lookups binary-search the mapped file, so resolving a branch costs the
+// same with ten branches or a hundred thousand. A loose branches/<name>.txt
+// file always overrides the packed entry of the same name; pack-refs folds
+// loose files back in.
+class PackedRefs {
+public:
+    static constexpr std::string_view HEADER = "# minigit packed-refs\n";
+
+    // Returns false if the file is missing or isn't a packed-refs file
+    bool load(const std::string &path) {
+        records = {};
+        if (!file.open(path)) return false;
+        std::string_view all = file.view();
+        if (all.substr(0, HEADER.size()) != HEADER) {
+            file = MappedFile();
+            return false;
+        }
+        records = all.substr(HEADER.size());
+        return true;
+    }
+
+    // Commit hash of a packed branch, or "" if it isn't packed
+    std::string find(std::string_view name) const {
+        size_t lo = 0, hi = records.size();
+        while (lo < hi) {
+            // Back up from the midpoint to the start of its record; lo and
+            // hi always sit on record boundaries
+            size_t start = lo + (hi - lo) / 2;
+            while (start > lo && records[start - 1] != '\n') --start;
+            size_t end = records.find('\n', start);
+            if (end == std::string_view::npos) end = records.size();
+
+            std::string_view hash, recordName;
+            if (!split(records.substr(start, end - start), hash, recordName)) return "";
+            int cmp = recordName.compare(name);
+            if (cmp == 0) return std::string(hash);
+            if (cmp < 0) lo = end + 1;
+            else hi = start;
+        }
+        return "";
+    }
+
+    // Calls fn(name, hash) for every packed branch in name order
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        std::string_view rest = records;
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            std::string_view hash, name;
+            if (split(rest.substr(0, end), hash, name)) fn(name, hash);
+            rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        }
+    }
+
+    // Writes (name, hash) pairs, sorting them, into a lock already held on
+    // the packed-refs file and commits it, so readers see the old file or
+    // the new one
+    static bool write(LockFile &lock, std::vector<std::pair<std::string, std::string>> refs) {
+        std::sort(refs.begin(), refs.end());
+        std::ofstream out(lock.lockPath(), std::ios::binary | std::ios::trunc);
+        out << HEADER;
+        for (const auto &[name, hash] : refs) out << hash << " " << name << "\n";
+        out.close();
+        return !out.fail() && lock.commit();
+    }
+
+private:
+    MappedFile file;
+    std::string_view records;
+
+    static bool split(std::string_view line, std::string_view &hash, std::string_view &name) {
+        if (line.size() < 42 || line[40] != ' ') return false;
+        hash = line.substr(0, 40);
+        name = line.substr(41);
+        return true;
+    }
+};
+
+#endif // REFS_H
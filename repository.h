@@ -0,0 +1,1768 @@
+// repository.h
+#ifndef REPOSITORY_H
+#define REPOSITORY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <unordered_set>
+#include <dirent.h>
+#include "sha1.h"
+#include "threadpool.h"
+#include "index.h"
+#include "objectstore.h"
+#include "commitgraph.h"
+#include "diff.h"
+#include "merge.h"
+#include "materialize.h"
+#include "tree.h"
+#include "commitfile.h"
+#include "bloom.h"
+#include "statcache.h"
+#include "refs.h"
+#include "lockfile.h"
+#include "similarity.h"
+#include "trace.h"
+
+// ---------------------
+// Repository
+// ---------------------
+// Every MiniGit operation, on one repository, returning structured results
+// instead of printing. A Repository keeps what it reads from .minigit
+// between calls: HEAD, branch files, the index and the object store are
+// revalidated by stat on every use, while commits and trees never change
+// once written and are cached by hash. So one long-lived object serves many
+// operations without rereading unchanged state, and still sees changes made
+// by other processes.
+//
+// Paths of working-tree files are relative to the work tree. A Repository
+// is not thread-safe; use one per thread.
+
+// Common to every result: ok is false when the operation was refused or
+// failed, with a one-line reason in error
+struct OpResult {
+    bool ok = true;
+    std::string error;
+};
+
+struct AddResult : OpResult {
+    std::vector<std::string> missing;   // arguments that don't exist
+    std::vector<std::string> outside;   // arguments outside the work tree
+    std::vector<std::string> added;     // new or changed in the index
+    std::vector<std::string> removed;   // tracked, but deleted from the work tree
+    std::vector<std::string> failed;    // could not be stored
+};
+
+struct CommitResult : OpResult {
+    std::string hash;
+};
+
+struct CommitInfo {
+    std::string hash, parent, date, message;
+};
+
+struct LogResult : OpResult {
+    bool walked = false;   // history was resolved, so error (if any) came mid-walk
+    size_t shown = 0;
+};
+
+struct BranchResult : OpResult {
+    std::string commit;
+};
+
+struct CheckoutResult : OpResult {
+    bool isBranch = false;
+    size_t written = 0, removed = 0;
+    std::vector<std::string> blocked;                               // local changes in the way
+    std::vector<std::pair<std::string, std::string>> writeErrors;  // (path, reason)
+};
+
+struct MergedFile {
+    enum class Outcome { AutoMerged, Conflict, TakenFromTarget, WriteFailed };
+    std::string path;
+    Outcome outcome;
+    size_t conflicts = 0;   // for Conflict
+    std::string error;      // for WriteFailed
+    std::string targetPath; // the target's path, when a rename on either side moved it
+};
+
+struct MergeResult : OpResult {
+    std::string currentBranch, lca;
+    std::vector<MergedFile> files;
+};
+
+struct FileDiff {
+    std::string path;
+    std::string oldBlob, newBlob;   // "" for an added or removed file
+    std::string patch;              // unified diff text
+    std::string oldPath;            // source of a rename or copy, else ""
+    int similarity = 0;             // of a rename or copy, in percent
+    bool copied = false;
+};
+
+struct CommitDiffResult : OpResult {
+    std::vector<FileDiff> files;
+};
+
+struct StatusEntry {
+    enum class Kind { NewFile, Modified, Deleted };
+    Kind kind;
+    std::string path;
+};
+
+struct StatusResult : OpResult {
+    std::vector<StatusEntry> staged, unstaged;
+    std::vector<std::string> untracked;   // by path; a directory with nothing tracked is "dir/"
+};
+
+struct BranchListResult : OpResult {
+    std::string current;   // checked-out branch, "" when detached
+    std::vector<std::pair<std::string, std::string>> branches;   // (name, commit), by name
+};
+
+struct PackRefsResult : OpResult {
+    size_t packed = 0;    // branches in packed-refs
+    size_t pruned = 0;    // loose files folded in and removed
+};
+
+struct MigrateResult : OpResult {
+    long moved = 0;
+};
+
+struct RepackResult : OpResult {
+    size_t packed = 0, deltas = 0;   // packed == 0: nothing to pack
+    std::string packName;
+    uintmax_t looseBytes = 0;
+    uint64_t packBytes = 0;
+    std::vector<std::string> skipped;   // unreadable objects
+};
+
+class Repository {
+public:
+    // Opens the repository whose .minigit directory sits in `workTree`. The
+    // directory need not exist yet; see init.
+    explicit Repository(std::string workTree = ".")
+        : workDir(std::move(workTree)), rootDir(workPath(".minigit")) {}
+
+    const std::string &workTree() const { return workDir; }
+    const std::string &root() const { return rootDir; }
+    bool isInitialized() const { return exists(rootDir); }
+
+    OpResult init() {
+        namespace fs = std::filesystem;
+        if (isInitialized()) return fail<OpResult>("MiniGit repo already initialized.");
+
+        fs::create_directory(rootDir);
+        ObjectStore(rootDir + "/objects").initialize();
+        fs::create_directory(rootDir + "/commits");
+        fs::create_directory(rootDir + "/branches");
+
+        std::ofstream headFile(rootDir + "/HEAD.txt");
+        headFile << "ref: main\n";
+        return {};
+    }
+
+    // ---------------------
+    // Repository state
+    // ---------------------
+    // First line of HEAD.txt: "ref: <branch>", or a commit hash when detached
+    std::string headRef() { return readFirstLine(rootDir + "/HEAD.txt"); }
+
+    // Resolves HEAD to a commit hash, or "null" before the first commit
+    std::string resolveHead() {
+        std::string head = headRef();
+        if (head.empty()) return "null";
+        if (head.rfind("ref:", 0) != 0) return head;  // detached HEAD
+
+        std::string commitHash = branchCommit(head.substr(5));
+        return commitHash.empty() ? "null" : commitHash;
+    }
+
+    // A branch is its loose branches/<name>.txt if there is one, else its
+    // packed-refs entry. Returns false if neither exists.
+    bool readBranch(const std::string &name, std::string &commitHash) {
+        if (const std::string *loose = readLine(branchPath(name))) {
+            commitHash = *loose;
+            return true;
+        }
+        const PackedRefs *packed = packedRefs();
+        commitHash = packed ? packed->find(name) : "";
+        return !commitHash.empty();
+    }
+
+    bool branchExists(const std::string &name) {
+        std::string commitHash;
+        return readBranch(name, commitHash);
+    }
+
+    // Commit a branch points at, or "" if there is no such branch
+    std::string branchCommit(const std::string &name) {
+        std::string commitHash;
+        readBranch(name, commitHash);
+        return commitHash;
+    }
+
+    bool commitExists(const std::string &hash) const { return exists(commitPath(hash)); }
+
+    bool openCommit(const std::string &commitHash, CommitFile &commit) const {
+        return commitHash != "null" && commit.open(commitPath(commitHash));
+    }
+
+    // The object store, reopened only when the pack directory or the
+    // fan-out marker changes. Callers hold the pointer for the rest of an
+    // operation, so a reopen never pulls packs out from under them.
+    std::shared_ptr<ObjectStore> objects() {
+        std::string dir = rootDir + "/objects";
+        int64_t takenNs = FileStamp::nowNs();
+        FileStamp packs = FileStamp::of(dir + "/pack");
+        FileStamp marker = FileStamp::of(dir + "/.fanout");
+
+        if (!store || !storeSettled || packs != storePacks || marker != storeMarker) {
+            store = std::make_shared<ObjectStore>(dir);
+            storePacks = packs;
+            storeMarker = marker;
+            storeSettled = packs.settled(takenNs) && marker.settled(takenNs);
+        }
+        return store;
+    }
+
+    // Root tree hash of a commit, "" for "null" or a missing commit. A tree
+    // for an old flat commit is built and stored the first time it is
+    // needed.
+    std::string commitTree(const std::string &commitHash) {
+        auto known = treesByCommit.find(commitHash);
+        if (known != treesByCommit.end()) return known->second;
+
+        CommitFile commit;
+        if (!openCommit(commitHash, commit)) return "";
+        std::string treeHash(commit.tree());
+        if (treeHash.empty() && !commit.files().empty()) {
+            StagingIndex legacy;
+            for (const auto &file : commit.files()) legacy.upsert({std::string(file.path), std::string(file.hash), {}});
+            std::string invalidPath;
+            treeHash = writeTree(*objects(), legacy, invalidPath);
+        }
+        if (!treeHash.empty()) treesByCommit[commitHash] = treeHash;
+        return treeHash;
+    }
+
+    // Every file of a commit as (filename, blob hash), sorted by filename.
+    // The last few tables are kept, since status and index ask for HEAD's.
+    FileTable commitFiles(const std::string &commitHash) {
+        const size_t MAX_CACHED = 4;
+        auto known = recentFiles.find(commitHash);
+        if (known != recentFiles.end()) return known->second;
+
+        FileTable files;
+        CommitFile commit;
+        if (!openCommit(commitHash, commit)) return files;
+
+        if (commit.tree().empty()) {
+            files.reserve(commit.files().size());
+            for (const auto &file : commit.files()) files.emplace_back(file.path, file.hash);
+        } else {
+            if (!flattenTree(*objects(), std::string(commit.tree()), files)) return {};
+            std::sort(files.begin(), files.end());
+        }
+
+        if (recentFiles.size() >= MAX_CACHED) recentFiles.clear();
+        recentFiles[commitHash] = files;
+        return files;
+    }
+
+    // Loads the staging index. Repos staged by older builds only have the
+    // text index.txt, which was cleared on every commit, so the HEAD
+    // snapshot is used as the base and any legacy entries are layered on
+    // top.
+    StagingIndex index() { return indexView(); }
+
+    // The same index without copying it, valid until the next call
+    const StagingIndex &indexView() {
+        const StagingIndex *cached = indexCache.get(rootDir + "/index",
+                                                    [](const std::string &path, StagingIndex &index) { return index.load(path); });
+        if (cached) return *cached;
+
+        StagingIndex &index = uncachedIndex;
+        index = StagingIndex();
+        for (const auto &[filename, hash] : commitFiles(resolveHead())) index.upsert({filename, hash, {}});
+
+        std::ifstream legacyIndex(rootDir + "/index.txt");
+        std::string line;
+        while (std::getline(legacyIndex, line)) {
+            std::istringstream ss(line);
+            std::string filename, hash;
+            if (ss >> filename >> hash) index.upsert({filename, hash, {}});
+        }
+        return index;
+    }
+
+    // Applies `edit` to the index as it is on disk now, holding index.lock,
+    // and writes it back if edit returns true. Concurrent add, commit and
+    // checkout each build on the others' entries; only this
+    // read-modify-write is serialized, not the hashing that precedes it.
+    OpResult updateIndex(const std::function<bool(StagingIndex &)> &edit) {
+        std::string path = rootDir + "/index";
+        LockFile lock;
+        if (!lock.acquire(path)) return fail<OpResult>(LockFile::busyMessage(path));
+        StagingIndex index = this->index();
+        if (!edit(index)) return {};
+        if (!index.save(lock)) return fail<OpResult>("Failed to write staging index.");
+        std::error_code ec;
+        std::filesystem::remove(rootDir + "/index.txt", ec);
+        return {};
+    }
+
+    // ---------------------
+    // Ref transactions
+    // ---------------------
+    // Moves a branch, or a detached HEAD for an empty name, from `expected`
+    // to `newHash` while holding its lock file. It's a compare-and-swap: of
+    // two writers that read the same old value only the first succeeds, and
+    // the other gets Stale and can re-read and retry. `expected` is "" for a
+    // branch that must not exist yet.
+    enum class RefUpdate { Done, Stale, Failed };
+
+    RefUpdate updateRef(const std::string &branch, const std::string &expected, const std::string &newHash,
+                        std::string &error) {
+        std::string path = branch.empty() ? rootDir + "/HEAD.txt" : branchPath(branch);
+        LockFile lock;
+        if (!lock.acquire(path)) {
+            error = LockFile::busyMessage(path);
+            return RefUpdate::Failed;
+        }
+
+        // Read past the caches: the value that counts is the one on disk now
+        std::string current;
+        std::ifstream in(path);
+        if (in.is_open()) {
+            std::getline(in, current);
+        } else if (!branch.empty()) {
+            PackedRefs packed;
+            if (packed.load(rootDir + "/packed-refs")) current = packed.find(branch);
+        }
+        if (current != expected) {
+            std::string name = branch.empty() ? "HEAD" : "Branch '" + branch + "'";
+            error = current.empty() ? name + " does not exist."
+                    : expected.empty() ? name + " already exists."
+                    : name + " moved to " + current + " while this update expected " + expected + ".";
+            return RefUpdate::Stale;
+        }
+
+        if (!writeLocked(lock, newHash)) {
+            error = "Failed to update " + path + ".";
+            return RefUpdate::Failed;
+        }
+        return RefUpdate::Done;
+    }
+
+    // Workers for parallel operations, started on first use
+    ThreadPool &workers() {
+        if (!pool) pool = std::make_unique<ThreadPool>();
+        return *pool;
+    }
+
+    // ---------------------
+    // ADD
+    // ---------------------
+    // Stages files; directories are added recursively, skipping .minigit.
+    // Files whose size, mtime and inode match the index aren't rehashed.
+    AddResult add(const std::vector<std::string> &paths) {
+        trace::Span span("add");
+        if (!isInitialized()) return fail<AddResult>("Repository not initialized. Run './minigit init' first.");
+
+        AddResult out;
+        StagingIndex index = this->index();
+
+        // Arguments become work-tree paths before anything is hashed; one
+        // that leads outside the work tree is refused. An index entry an
+        // older build stored under such a path is unstaged, since no
+        // commit can hold it.
+        std::vector<std::string> relative;
+        std::set<std::string> invalid;
+        for (const auto &path : paths) {
+            std::string inTree;
+            if (workTreeRelative(path, inTree)) {
+                relative.push_back(inTree);
+                continue;
+            }
+            out.outside.push_back(path);
+            if (index.find(trackedKey(path))) invalid.insert(trackedKey(path));
+        }
+
+        std::vector<std::string> files;
+        {
+            trace::Span collect("add.collect");
+            files = collectFiles(relative, out.missing);
+        }
+
+        // A tracked file under an argument that is gone from disk is
+        // unstaged, like `git add` staging a deletion; a missing argument
+        // is only "not found" if nothing under it is tracked
+        out.removed = deletedUnder(index, relative, files);
+        out.removed.insert(out.removed.end(), invalid.begin(), invalid.end());
+        out.missing.erase(std::remove_if(out.missing.begin(), out.missing.end(),
+                                         [&](const std::string &path) { return isTracked(index, path); }),
+                          out.missing.end());
+        if (files.empty() && out.removed.empty()) return out;
+
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+
+        // Each result lands in its own slot, so the lists below are in path
+        // order however the workers finish
+        struct Hashed {
+            IndexEntry entry;
+            bool changed = false;
+            bool rehashed = false;
+            bool failed = false;
+        };
+        std::vector<Hashed> results(files.size());
+        {
+            trace::Span hashing("add.hash");
+            workers().parallelFor(files.size(), [&](size_t i) {
+                Hashed &result = results[i];
+                result.entry.path = files[i];
+                if (!statFile(workPath(files[i]), result.entry.stat)) {
+                    result.failed = true;
+                    return;
+                }
+
+                const IndexEntry *existing = index.find(files[i]);
+                if (existing && index.isClean(*existing, result.entry.stat)) {
+                    result.entry.hash = existing->hash;
+                    return;
+                }
+
+                result.entry.hash = store.storeFile(workPath(files[i]));
+                result.rehashed = true;
+                result.failed = result.entry.hash.empty();
+                result.changed = !existing || existing->hash != result.entry.hash;
+            });
+        }
+
+        for (const auto &result : results) {
+            if (result.failed) out.failed.push_back(result.entry.path);
+            else if (result.changed) out.added.push_back(result.entry.path);
+        }
+
+        // Record staging info in one batch, on top of whatever other
+        // writers staged meanwhile
+        OpResult saved = updateIndex([&](StagingIndex &current) {
+            bool dirty = false;
+            for (const auto &path : out.removed) {
+                dirty = dirty || current.find(path);
+                current.erase(path);
+            }
+            for (auto &result : results) {
+                if (result.failed) continue;
+                const IndexEntry *existing = current.find(result.entry.path);
+                if (result.rehashed || !existing || existing->hash != result.entry.hash ||
+                    std::memcmp(&existing->stat, &result.entry.stat, sizeof(FileStat)) != 0) {
+                    dirty = true;
+                }
+                current.upsert(std::move(result.entry));
+            }
+            return dirty;
+        });
+        if (!saved.ok) {
+            out.ok = false;
+            out.error = saved.error;
+            out.added.clear();
+            out.removed.clear();
+        }
+        return out;
+    }
+
+    // ---------------------
+    // COMMIT
+    // ---------------------
+    CommitResult commit(const std::string &message) {
+        trace::Span span("commit");
+        if (!isInitialized()) {
+            return fail<CommitResult>("Nothing to commit. Stage files first using './minigit add <file>'.");
+        }
+
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+
+        // The branch only moves if it still points at the parent this
+        // commit was built on. When another writer got there first, the
+        // tree is rebuilt from the index as it is now, which holds their
+        // staged files too, and committed on top of theirs.
+        for (int attempt = 1;; ++attempt) {
+            std::string head = headRef();
+            std::string branch = head.rfind("ref:", 0) == 0 ? head.substr(5) : "";
+            std::string parentHash = branch.empty() ? head : branchCommit(branch);
+            if (parentHash.empty()) parentHash = "null";
+
+            // Write trees for the directories that changed since the last
+            // commit; an unchanged index reproduces the parent's root tree
+            std::string treeHash;
+            {
+                std::string indexPath = rootDir + "/index";
+                LockFile indexLock;
+                if (!indexLock.acquire(indexPath)) return fail<CommitResult>(LockFile::busyMessage(indexPath));
+                StagingIndex index = this->index();
+                // An empty index can still commit the removal of every file
+                if (index.empty() && parentHash == "null") return fail<CommitResult>("No files staged for commit.");
+
+                trace::Span trees("commit.write-tree");
+                std::string invalidPath;
+                treeHash = writeTree(store, index, invalidPath);
+                if (!invalidPath.empty()) {
+                    return fail<CommitResult>("Invalid path in the staging index: " + invalidPath +
+                                              ". Run './minigit add " + invalidPath + "' to unstage it.");
+                }
+                if (treeHash.empty()) return fail<CommitResult>("Failed to write tree objects.");
+                if (!index.save(indexLock)) return fail<CommitResult>("Failed to write staging index.");
+            }
+
+            std::string parentTree = commitTree(parentHash);
+            if (treeHash == parentTree) {
+                return fail<CommitResult>("Nothing to commit. Staged files match the current commit.");
+            }
+
+            // Generate commit hash
+            time_t commitTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+            std::string timestamp = std::ctime(&commitTime);
+            std::string commitHash = sha1(message + timestamp + treeHash);
+
+            std::ofstream commitFile(commitPath(commitHash));
+            commitFile << "Commit: " << commitHash << "\n";
+            commitFile << "Parent: " << parentHash << "\n";
+            commitFile << "Date: " << timestamp;
+            commitFile << "Message: " << message << "\n";
+            commitFile << "Tree: " << treeHash << "\n";
+            commitFile.close();
+
+            // Advance the branch, or HEAD itself if detached. A commit file
+            // left by a lost race is unreachable and harmless; removing it
+            // could take out a winner's identical commit.
+            std::string error;
+            RefUpdate update = updateRef(branch, parentHash == "null" ? "" : parentHash, commitHash, error);
+            if (update == RefUpdate::Stale && attempt < MAX_COMMIT_ATTEMPTS) continue;
+            if (update != RefUpdate::Done) return fail<CommitResult>(error);
+
+            recordCommit(store, commitHash, parentHash, parentTree, treeHash, commitTime);
+
+            CommitResult out;
+            out.hash = commitHash;
+            return out;
+        }
+    }
+
+    // ---------------------
+    // LOG
+    // ---------------------
+    // Calls visit for each commit from HEAD back to the root, newest first,
+    // until it returns false. With a path, only commits that changed it (or
+    // anything under it, for a directory) are visited. Each commit's Bloom
+    // filter rules most commits out without reading their trees; a "maybe"
+    // is confirmed against the trees.
+    LogResult log(std::string path, const std::function<bool(const CommitInfo &)> &visit) {
+        trace::Span span("log");
+        if (!exists(rootDir + "/HEAD.txt")) {
+            return fail<LogResult>("Repository not initialized or no commits yet.");
+        }
+
+        std::string head = headRef();
+        std::string currentHash = head;
+        if (head.rfind("ref:", 0) == 0) {
+            std::string branchName = head.substr(5);
+            if (!branchExists(branchName)) return fail<LogResult>("Error: Branch '" + branchName + "' not found.");
+            currentHash = branchCommit(branchName);
+        }
+
+        // Walk the ancestry through the commit graph
+        CommitGraph graph;
+        if (!openCommitGraph(graph, {currentHash})) return fail<LogResult>("Error: Could not read commit history.");
+
+        while (path.rfind("./", 0) == 0) path.erase(0, 2);
+        while (!path.empty() && path.back() == '/') path.pop_back();
+        BloomIndex bloom;
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+        if (!path.empty()) bloom.load(rootDir + "/commit-bloom");
+
+        LogResult out;
+        out.walked = true;
+        trace::Span walk("log.walk");
+        for (uint32_t at = graph.find(currentHash); at != CommitGraph::NONE; at = graph.parent(at)) {
+            std::string hash = graph.hash(at);
+            if (!path.empty()) {
+                if (!bloom.mightHaveChanged(hash, path)) continue;
+                std::string parent = graph.parent(at) == CommitGraph::NONE ? "null" : graph.hash(graph.parent(at));
+                if (lookupPath(store, commitTree(hash), path, true) == lookupPath(store, commitTree(parent), path, true)) {
+                    continue;
+                }
+            }
+
+            CommitFile commit;
+            if (!openCommit(hash, commit)) {
+                out.ok = false;
+                out.error = "Error: Commit file missing for hash " + hash;
+                break;
+            }
+            ++out.shown;
+            CommitInfo info{std::string(commit.commit()), std::string(commit.parent()), std::string(commit.date()),
+                            std::string(commit.message())};
+            if (!visit(info)) break;
+        }
+        return out;
+    }
+
+    // ---------------------
+    // BRANCH
+    // ---------------------
+    BranchResult createBranch(const std::string &branchName) {
+        trace::Span span("branch");
+        if (!exists(rootDir + "/HEAD.txt")) return fail<BranchResult>("Repository not initialized.");
+        if (branchExists(branchName)) return fail<BranchResult>("Branch '" + branchName + "' already exists.");
+
+        BranchResult out;
+        std::string head = headRef();
+        if (head.rfind("ref:", 0) == 0) {
+            std::string currentBranch = head.substr(5);
+
+            // If the branch doesn't exist yet, we likely haven't committed yet
+            if (!branchExists(currentBranch)) {
+                return fail<BranchResult>("Error: Cannot create branch before first commit on current branch '" +
+                                          currentBranch + "'.");
+            }
+            out.commit = branchCommit(currentBranch);
+        } else {
+            // HEAD is a commit hash directly (e.g., after checkout)
+            out.commit = head;
+        }
+
+        // Created only if no other writer made it meanwhile
+        std::string error;
+        if (updateRef(branchName, "", out.commit, error) != RefUpdate::Done) return fail<BranchResult>(error);
+        return out;
+    }
+
+    // Lists every branch from one read of packed-refs and one listing of
+    // branches/, without a stat per branch. Loose files override packed
+    // entries of the same name.
+    BranchListResult listBranches() {
+        trace::Span span("branch.list");
+        if (!exists(rootDir + "/HEAD.txt")) return fail<BranchListResult>("Repository not initialized.");
+
+        BranchListResult out;
+        std::string head = headRef();
+        if (head.rfind("ref:", 0) == 0) out.current = head.substr(5);
+
+        std::map<std::string, std::string> all;
+        if (const PackedRefs *packed = packedRefs()) {
+            packed->forEach([&](std::string_view name, std::string_view hash) { all[std::string(name)] = hash; });
+        }
+        for (const auto &[name, hash] : looseBranches()) all[name] = hash;
+        out.branches.assign(all.begin(), all.end());
+        return out;
+    }
+
+    // Folds every loose branch file into packed-refs and removes the loose
+    // files, except any rewritten while packing. packed-refs is read and
+    // rewritten under its lock, so two pack-refs never drop each other's
+    // entries, and each loose file is only removed under its own lock.
+    PackRefsResult packRefs() {
+        trace::Span span("pack-refs");
+        if (!isInitialized()) return fail<PackRefsResult>("Repository not initialized.");
+
+        std::string packedPath = rootDir + "/packed-refs";
+        LockFile packedLock;
+        if (!packedLock.acquire(packedPath)) return fail<PackRefsResult>(LockFile::busyMessage(packedPath));
+
+        std::map<std::string, std::string> all;
+        PackedRefs packed;
+        if (packed.load(packedPath)) {
+            packed.forEach([&](std::string_view name, std::string_view hash) { all[std::string(name)] = hash; });
+        }
+        std::vector<std::pair<std::string, std::string>> loose = looseBranches();
+        for (const auto &[name, hash] : loose) {
+            // Only a full hash can be packed; anything else stays loose
+            if (hash.size() == 40) all[name] = hash;
+        }
+
+        if (!PackedRefs::write(packedLock, {all.begin(), all.end()})) {
+            return fail<PackRefsResult>("Failed to write packed-refs.");
+        }
+
+        PackRefsResult out;
+        out.packed = all.size();
+        for (const auto &[name, hash] : loose) {
+            if (hash.size() != 40) continue;
+            LockFile refLock;
+            if (!refLock.acquire(branchPath(name))) continue;
+            std::ifstream in(branchPath(name));
+            std::string now;
+            std::getline(in, now);
+            in.close();
+            if (now == hash && std::remove(branchPath(name).c_str()) == 0) ++out.pruned;
+        }
+        return out;
+    }
+
+    // ---------------------
+    // CHECKOUT
+    // ---------------------
+    // Only paths whose blob differs between HEAD and the target are
+    // touched; everything else is left alone along with its index entry.
+    // The tree diff never descends into subtrees the two commits share.
+    CheckoutResult checkout(const std::string &target) {
+        trace::Span span("checkout");
+        CheckoutResult out;
+        std::string commitHash = target;
+        if (branchExists(target)) {
+            out.isBranch = true;
+            commitHash = branchCommit(target);
+        }
+        if (!commitExists(commitHash)) return fail<CheckoutResult>("Commit not found for: " + target);
+
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+        const StagingIndex &index = indexView();
+
+        // Hash of the working file, or "" if it is missing. Clean stat data
+        // answers without reading the file.
+        auto workingHash = [&](const std::string &filename) -> std::string {
+            FileStat current;
+            if (!statFile(workPath(filename), current)) return "";
+            const IndexEntry *entry = index.find(filename);
+            if (entry && index.isClean(*entry, current)) return entry->hash;
+            return hashFile(workPath(filename));
+        };
+
+        std::vector<std::pair<std::string, std::string>> writes, upToDate;
+        std::vector<std::string> removals;
+        {
+            trace::Span compare("checkout.compare");
+            diffTrees(store, commitTree(resolveHead()), commitTree(commitHash),
+                      [&](const std::string &filename, const std::string &headBlob, const std::string &targetBlob) {
+                          std::string current = workingHash(filename);
+                          if (targetBlob.empty()) {
+                              if (current.empty() || current == headBlob) removals.push_back(filename);
+                              else out.blocked.push_back(filename);
+                          } else if (current == targetBlob) {
+                              upToDate.emplace_back(filename, targetBlob);
+                          } else if (current.empty() || current == headBlob) {
+                              writes.emplace_back(filename, targetBlob);
+                          } else {
+                              out.blocked.push_back(filename);
+                          }
+                      });
+        }
+
+        // Never overwrite or delete work that is not in any commit
+        if (!out.blocked.empty()) {
+            out.ok = false;
+            out.error = "Your local changes to the following files would be overwritten by checkout.";
+            return out;
+        }
+
+        std::vector<std::pair<std::string, std::string>> targets;
+        for (const auto &[filename, hash] : writes) targets.emplace_back(workPath(filename), hash);
+        std::vector<MaterializeResult> results = materializeBlobs(store, targets, workers());
+        std::vector<IndexEntry> entries;
+        for (size_t i = 0; i < writes.size(); ++i) {
+            // A file that failed to write keeps its old entry, so status
+            // doesn't take the missing or stale file for the target's
+            const auto &[filename, hash] = writes[i];
+            if (!results[i].ok) out.writeErrors.emplace_back(filename, results[i].error);
+            else entries.push_back({filename, hash, results[i].stat});
+        }
+        for (const auto &[filename, hash] : upToDate) {
+            IndexEntry entry{filename, hash, {}};
+            statFile(workPath(filename), entry.stat);
+            entries.push_back(std::move(entry));
+        }
+        for (const auto &filename : removals) {
+            std::error_code ec;
+            std::filesystem::remove(workPath(filename), ec);
+
+            // Drop directories the removal left empty
+            std::filesystem::path dir = std::filesystem::path(filename).parent_path();
+            while (!dir.empty() && std::filesystem::is_empty(workPath(dir.string()), ec) && !ec &&
+                   std::filesystem::remove(workPath(dir.string()), ec)) {
+                dir = dir.parent_path();
+            }
+        }
+        OpResult saved = updateIndex([&](StagingIndex &current) {
+            for (auto &entry : entries) current.upsert(std::move(entry));
+            for (const auto &filename : removals) current.erase(filename);
+            return !entries.empty() || !removals.empty();
+        });
+        if (!saved.ok) return fail<CheckoutResult>(saved.error);
+
+        std::string headPath = rootDir + "/HEAD.txt";
+        LockFile headLock;
+        if (!headLock.acquire(headPath)) return fail<CheckoutResult>(LockFile::busyMessage(headPath));
+        if (!writeLocked(headLock, out.isBranch ? "ref: " + target : commitHash)) {  // else detached
+            return fail<CheckoutResult>("Failed to update HEAD.");
+        }
+
+        out.written = writes.size() - out.writeErrors.size();
+        out.removed = removals.size();
+        return out;
+    }
+
+    // ---------------------
+    // MERGE
+    // ---------------------
+    // Three-way merge of another branch into the current one, file by file
+    // against their lowest common ancestor. Files both sides changed are
+    // merged line by line, with conflict markers where they disagree.
+    MergeResult merge(const std::string &targetBranch) {
+        trace::Span span("merge");
+        std::string head = headRef();
+        if (head.rfind("ref:", 0) != 0) {
+            return fail<MergeResult>("You must be on a branch to perform a merge (not detached).");
+        }
+
+        MergeResult out;
+        out.currentBranch = head.substr(5);
+        if (!branchExists(out.currentBranch) || !branchExists(targetBranch)) {
+            return fail<MergeResult>("Error: One or both branches do not exist.");
+        }
+        std::string currentHash = branchCommit(out.currentBranch);
+        std::string targetHash = branchCommit(targetBranch);
+
+        // Find the LCA through the commit graph's generation numbers
+        CommitGraph graph;
+        out.lca = "null";
+        {
+            trace::Span findLca("merge.find-lca");
+            if (openCommitGraph(graph, {currentHash, targetHash})) {
+                uint32_t ancestor = graph.lowestCommonAncestor(graph.find(currentHash), graph.find(targetHash));
+                if (ancestor != CommitGraph::NONE) out.lca = graph.hash(ancestor);
+            }
+        }
+        if (out.lca == "null") return fail<MergeResult>("No common ancestor. Cannot merge.");
+
+        // Only paths the target changed since the LCA can need merging; the
+        // tree diff finds them without reading shared subtrees
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+        std::string currentTree = commitTree(currentHash);
+        struct Change {
+            std::string filename, lcaBlob, targetBlob, targetPath;
+        };
+        std::vector<Change> targetChanges;
+        std::string lcaTree = commitTree(out.lca), targetTree = commitTree(targetHash);
+        diffTrees(store, lcaTree, targetTree,
+                  [&](const std::string &filename, const std::string &lcaBlob, const std::string &targetBlob) {
+                      // Files the target added or deleted are left alone
+                      if (lcaBlob.empty() || targetBlob.empty()) return;
+                      targetChanges.push_back({filename, lcaBlob, targetBlob, filename});
+                  });
+
+        // A file the target renamed and edited is an edit to its old path
+        for (const auto &rename : findRenames(store, lcaTree, targetTree)) {
+            if (rename.oldBlob == rename.newBlob) continue;
+            targetChanges.push_back({rename.oldPath, rename.oldBlob, rename.newBlob, rename.newPath});
+        }
+
+        // Where the current branch renamed a file, the change goes to its
+        // new path; looked up only if some changed file is missing here
+        std::map<std::string, std::string> currentRenames;
+        bool currentRenamesFound = false;
+
+        std::vector<std::pair<std::string, std::string>> takeTarget;
+        std::vector<std::string> takenPaths, takenTargetPaths;
+        for (const auto &[lcaPath, lcaBlob, blobB, targetPath] : targetChanges) {
+            std::string filename = lcaPath;
+            std::string blobA = lookupPath(store, currentTree, filename);
+            if (blobA.empty()) {
+                if (!currentRenamesFound) {
+                    for (const auto &rename : findRenames(store, lcaTree, currentTree)) {
+                        currentRenames[rename.oldPath] = rename.newPath;
+                    }
+                    currentRenamesFound = true;
+                }
+                auto renamed = currentRenames.find(filename);
+                if (renamed != currentRenames.end()) {
+                    filename = renamed->second;
+                    blobA = lookupPath(store, currentTree, filename);
+                }
+            }
+            std::string movedTo = targetPath != filename ? targetPath : "";
+            if (blobA == blobB) continue;  // both sides made the same change
+
+            if (blobA == lcaBlob) {
+                // Only the target changed it: take the target's blob as is
+                takeTarget.emplace_back(workPath(filename), blobB);
+                takenPaths.push_back(filename);
+                takenTargetPaths.push_back(movedTo);
+                continue;
+            }
+
+            // Both sides changed the file: merge line by line against the LCA
+            auto opener = [&](const std::string &blob) -> StreamOpener {
+                return [&store, blob]() { return blob.empty() ? nullptr : store.open(blob); };
+            };
+            trace::Span lines("merge.lines");
+            // Written beside the file and renamed over it, so a failed write
+            // leaves the current version in place
+            std::string tempPath = workPath(filename) + ".minigit-merge";
+            std::ofstream merged(tempPath, std::ios::binary);
+            std::string writeError;
+            size_t conflicts = 0;
+            if (!merged.is_open()) {
+                writeError = std::strerror(errno);  // before any other call can change it
+            } else {
+                try {
+                    conflicts = mergeLines(opener(lcaBlob), opener(blobA), opener(blobB), merged, "current", targetBranch);
+                    merged.close();
+                } catch (...) {
+                    merged.close();
+                    std::error_code ec;
+                    std::filesystem::remove(tempPath, ec);
+                    throw;
+                }
+                std::error_code ec;
+                if (merged.fail()) writeError = "could not write merged file";
+                else std::filesystem::rename(tempPath, workPath(filename), ec);
+                if (ec) writeError = ec.message();
+                if (!writeError.empty()) std::filesystem::remove(tempPath, ec);
+            }
+            if (!writeError.empty()) {
+                out.files.push_back({filename, MergedFile::Outcome::WriteFailed, 0, writeError, movedTo});
+                continue;
+            }
+
+            MergedFile file{filename, conflicts > 0 ? MergedFile::Outcome::Conflict : MergedFile::Outcome::AutoMerged,
+                            conflicts, "", movedTo};
+            out.files.push_back(std::move(file));
+        }
+
+        std::vector<MaterializeResult> results = materializeBlobs(store, takeTarget, workers());
+        for (size_t i = 0; i < takeTarget.size(); ++i) {
+            if (results[i].ok) {
+                out.files.push_back({takenPaths[i], MergedFile::Outcome::TakenFromTarget, 0, "", takenTargetPaths[i]});
+            } else {
+                out.files.push_back(
+                    {takenPaths[i], MergedFile::Outcome::WriteFailed, 0, results[i].error, takenTargetPaths[i]});
+            }
+        }
+        return out;
+    }
+
+    // ---------------------
+    // DIFF
+    // ---------------------
+    // Unified diffs of every file whose blob differs between two commits,
+    // in tree order. Identical subtrees and blobs are skipped by hash, so
+    // unchanged files are never opened. An added file similar to a removed
+    // one is shown as a rename, and one similar to a modified file (or a
+    // second match for a removed one) as a copy.
+    //
+    // Files are diffed on the worker pool, at most a window of them ahead
+    // of the next one due, and handed back in order. With onFile, each
+    // file is passed to it as soon as it and every file before it are done
+    // and isn't kept in the result, so output starts after the first file
+    // and the patches held in memory are bounded by the window.
+    CommitDiffResult diff(const std::string &hash1, const std::string &hash2,
+                          DiffAlgorithm algorithm = DiffAlgorithm::Myers,
+                          const std::function<void(const FileDiff &)> &onFile = nullptr) {
+        trace::Span span("diff");
+        for (const auto &hash : {hash1, hash2}) {
+            if (!commitExists(hash)) return fail<CommitDiffResult>("Commit not found: " + hash);
+        }
+
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+        std::vector<FileDiff> files;
+        diffTrees(store, commitTree(hash1), commitTree(hash2),
+                  [&](const std::string &filename, const std::string &blob1, const std::string &blob2) {
+                      files.push_back({filename, blob1, blob2, "", ""});
+                  });
+        pairRenames(store, files);
+
+        CommitDiffResult out;
+        // A streamed file is dropped as soon as onFile returns, patch and
+        // all, so only the window's patches are ever held at once. Moving
+        // out frees the buffers; assigning an empty FileDiff would keep
+        // their capacity.
+        auto emit = [&](FileDiff &file) {
+            if (!onFile) {
+                out.files.push_back(std::move(file));
+                return;
+            }
+            onFile(file);
+            FileDiff released = std::move(file);
+        };
+        if (files.size() < 2) {
+            for (auto &file : files) {
+                writePatch(store, file, algorithm);
+                emit(file);
+            }
+            return out;
+        }
+
+        // Reorder buffer: a slot per file, filled by whichever worker gets
+        // to it and drained strictly in order by this thread
+        struct Slot {
+            bool ready = false;
+            std::exception_ptr error;
+        };
+        std::vector<Slot> slots(files.size());
+        std::mutex slotMutex;
+        std::condition_variable slotReady;
+        ThreadPool &pool = workers();
+        size_t window = pool.size() * 4;
+
+        auto submit = [&](size_t i) {
+            pool.submit([&, i] {
+                std::exception_ptr failure;
+                try {
+                    writePatch(store, files[i], algorithm);
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(slotMutex);
+                slots[i] = {true, failure};
+                slotReady.notify_all();
+            });
+        };
+
+        size_t submitted = std::min(window, files.size());
+        for (size_t i = 0; i < submitted; ++i) submit(i);
+        std::exception_ptr error;
+        for (size_t i = 0; i < files.size() && !error; ++i) {
+            {
+                std::unique_lock<std::mutex> lock(slotMutex);
+                slotReady.wait(lock, [&] { return slots[i].ready; });
+                error = slots[i].error;
+            }
+            if (submitted < files.size()) submit(submitted++);
+            if (error) break;
+            try {
+                emit(files[i]);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        // Tasks reference this frame, so let them all finish first
+        pool.wait();
+        if (error) std::rethrow_exception(error);
+        return out;
+    }
+
+    // ---------------------
+    // STATUS
+    // ---------------------
+    // Staged: the index differs from HEAD. Unstaged: the working tree
+    // differs from the index, deciding by stat data first and rehashing only
+    // files whose stat changed. Untracked: files the index doesn't know.
+    //
+    // The working tree is walked one directory per task on the worker
+    // pool, and the files whose stat changed are hashed there too, so a
+    // clean tree costs one readdir per directory and one stat per tracked
+    // file, spread across cores.
+    StatusResult status() {
+        trace::Span span("status");
+        if (!isInitialized()) return fail<StatusResult>("Repository not initialized.");
+
+        StatusResult out;
+        const StagingIndex &index = indexView();
+        std::string headHash = resolveHead();
+
+        // The index's cached root tree matching HEAD's proves nothing is
+        // staged without listing HEAD at all
+        std::string cachedRoot = index.cachedTree("");
+        if (cachedRoot.empty() || cachedRoot != commitTree(headHash)) {
+            FileTable headFiles = commitFiles(headHash);
+
+            // Both are sorted by path, so a single merge pass pairs them up;
+            // a HEAD file the index no longer has is a staged deletion
+            auto head = headFiles.begin();
+            for (const auto &[filename, entry] : index.all()) {
+                for (; head != headFiles.end() && head->first < filename; ++head) {
+                    out.staged.push_back({StatusEntry::Kind::Deleted, head->first});
+                }
+                if (head == headFiles.end() || head->first != filename) {
+                    out.staged.push_back({StatusEntry::Kind::NewFile, filename});
+                    continue;
+                }
+                if (head->second != entry.hash) out.staged.push_back({StatusEntry::Kind::Modified, filename});
+                ++head;
+            }
+            for (; head != headFiles.end(); ++head) out.staged.push_back({StatusEntry::Kind::Deleted, head->first});
+        }
+
+        trace::Span worktree("status.worktree");
+        WorkTreeScan scan;
+        {
+            trace::Span walk("status.walk");
+            ThreadPool &pool = workers();
+            pool.submit([&] { scanDirectory(index, "", scan, pool); });
+            pool.wait();
+        }
+
+        std::vector<char> modified(scan.changed.size(), 0);
+        {
+            trace::Span hashing("status.hash");
+            workers().parallelFor(scan.changed.size(), [&](size_t i) {
+                const IndexEntry &entry = *scan.changed[i];
+                modified[i] = hashFile(workPath(entry.path)) != entry.hash;
+            });
+        }
+
+        std::unordered_set<const IndexEntry*> seen(scan.seen.begin(), scan.seen.end()), changed;
+        for (size_t i = 0; i < scan.changed.size(); ++i) {
+            if (modified[i]) changed.insert(scan.changed[i]);
+        }
+        for (const auto &[filename, entry] : index.all()) {
+            if (!seen.count(&entry)) out.unstaged.push_back({StatusEntry::Kind::Deleted, filename});
+            else if (changed.count(&entry)) out.unstaged.push_back({StatusEntry::Kind::Modified, filename});
+        }
+        out.untracked = std::move(scan.untracked);
+        std::sort(out.untracked.begin(), out.untracked.end());
+        return out;
+    }
+
+    // ---------------------
+    // MIGRATE-OBJECTS
+    // ---------------------
+    MigrateResult migrateObjects() {
+        trace::Span span("migrate-objects");
+        if (!isInitialized()) return fail<MigrateResult>("Repository not initialized.");
+
+        MigrateResult out;
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        out.moved = storeHandle->migrateFlat();
+        if (out.moved < 0) return fail<MigrateResult>("Some objects could not be moved. Re-run migrate-objects to retry.");
+        return out;
+    }
+
+    // ---------------------
+    // REPACK
+    // ---------------------
+    // Packs every object into one pack file. Versions of the same file are
+    // chained newest first, so the version checked out most often is stored
+    // whole and each older one is a delta against its successor.
+    RepackResult repack() {
+        trace::Span span("repack");
+        namespace fs = std::filesystem;
+        const int MAX_DELTA_DEPTH = 10;
+        if (!isInitialized()) return fail<RepackResult>("Repository not initialized.");
+
+        std::shared_ptr<ObjectStore> storeHandle = objects();
+        const ObjectStore &store = *storeHandle;
+        RepackResult out;
+
+        // 1. Order commits newest first by generation
+        CommitGraph graph;
+        std::vector<std::pair<uint32_t, std::string>> commits;
+        if (rebuildCommitGraph() && graph.load(rootDir + "/commit-graph")) {
+            for (uint32_t i = 0; i < graph.size(); ++i) commits.emplace_back(graph.generation(i), graph.hash(i));
+        }
+        std::sort(commits.rbegin(), commits.rend());
+
+        // 2. Group blob versions by the filename they were committed under
+        std::set<std::string> available;
+        for (const auto &hash : store.looseObjects()) available.insert(hash);
+        for (const auto &pack : store.packFiles()) {
+            for (uint32_t i = 0; i < pack->count(); ++i) available.insert(pack->hashAt(i));
+        }
+
+        std::map<std::string, std::vector<std::string>> versionsByFile;
+        std::set<std::string> grouped;
+        for (const auto &[depth, commitHash] : commits) {
+            for (const auto &[filename, blob] : commitFiles(commitHash)) {
+                if (available.count(blob) && grouped.insert(blob).second) versionsByFile[filename].push_back(blob);
+            }
+        }
+
+        std::vector<std::vector<std::string>> chains;
+        for (auto &[filename, versions] : versionsByFile) chains.push_back(std::move(versions));
+        for (const auto &hash : available) {
+            if (!grouped.count(hash)) chains.push_back({hash});
+        }
+
+        // 3. Write the pack
+        fs::create_directories(store.packDirectory());
+        PackWriter writer(store.tempPath());
+        std::vector<std::string> packedLoose;
+
+        for (const auto &chain : chains) {
+            std::string previous;
+            uint64_t previousOffset = 0;
+            int depth = -1;
+
+            for (const auto &hash : chain) {
+                std::string content;
+                std::string loosePath = store.find(hash);
+                // Chunk lists stay loose; their chunks are packed like any other object
+                if (!loosePath.empty() &&
+                    (fs::file_size(loosePath) > ObjectStore::PACK_SIZE_LIMIT || store.isChunked(hash))) continue;
+                if (!store.readAll(hash, content)) {
+                    out.skipped.push_back(hash);
+                    continue;
+                }
+
+                uint64_t offset = 0;
+                std::string ops;
+                if (depth >= 0 && depth < MAX_DELTA_DEPTH) ops = delta::create(previous, content);
+                if (!ops.empty() && ops.size() < content.size() / 2) {
+                    offset = writer.addDelta(hash, previousOffset, ops);
+                    ++depth;
+                    ++out.deltas;
+                } else {
+                    offset = writer.addFull(hash, content);
+                    depth = 0;
+                }
+
+                if (!loosePath.empty()) {
+                    out.looseBytes += fs::file_size(loosePath);
+                    packedLoose.push_back(hash);
+                }
+                previous = std::move(content);
+                previousOffset = offset;
+                ++out.packed;
+            }
+        }
+
+        if (out.packed == 0) return out;
+
+        out.packBytes = writer.bytesWritten();
+        if (!writer.good() || !writer.finish(store.packDirectory(), out.packName)) {
+            return fail<RepackResult>("Failed to write pack file.");
+        }
+
+        // 4. Drop loose copies and the packs this one replaces
+        for (const auto &hash : packedLoose) store.removeLoose(hash);
+        for (const auto &entry : fs::directory_iterator(store.packDirectory())) {
+            std::string stem = entry.path().stem().string();
+            if (stem != out.packName && (entry.path().extension() == ".pack" || entry.path().extension() == ".idx")) {
+                fs::remove(entry.path());
+            }
+        }
+        return out;
+    }
+
+private:
+    std::string workDir, rootDir;
+
+    FileCache<std::string> lines;
+    FileCache<PackedRefs> packedCache;
+    FileCache<StagingIndex> indexCache;
+    StagingIndex uncachedIndex;
+    std::shared_ptr<ObjectStore> store;
+    FileStamp storePacks, storeMarker;
+    bool storeSettled = false;
+    std::map<std::string, std::string> treesByCommit;
+    std::map<std::string, FileTable> recentFiles;
+    std::map<std::string, similarity::Sketch> sketchCache;
+    std::unique_ptr<ThreadPool> pool;
+
+    static constexpr size_t MAX_SKETCHES = 1 << 16;
+    static constexpr int MAX_COMMIT_ATTEMPTS = 100;
+
+    template <typename Result>
+    static Result fail(std::string error) {
+        Result result;
+        result.ok = false;
+        result.error = std::move(error);
+        return result;
+    }
+
+    static bool exists(const std::string &path) {
+        trace::count(trace::FileStats);
+        return std::filesystem::exists(path);
+    }
+
+    std::string workPath(const std::string &path) const { return workDir == "." ? path : workDir + "/" + path; }
+    std::string branchPath(const std::string &name) const { return rootDir + "/branches/" + name + ".txt"; }
+    std::string commitPath(const std::string &hash) const { return rootDir + "/commits/" + hash + ".txt"; }
+
+    // First line of a small repository file such as HEAD.txt or a branch
+    // file, or nullptr if the file is missing
+    const std::string *readLine(const std::string &path) {
+        return lines.get(path, [](const std::string &file, std::string &out) {
+            std::ifstream in(file);
+            std::getline(in, out);
+            return true;
+        });
+    }
+
+    std::string readFirstLine(const std::string &path) {
+        const std::string *line = readLine(path);
+        return line ? *line : "";
+    }
+
+    // Writes a one-line file such as a branch or HEAD through its held lock
+    static bool writeLocked(LockFile &lock, const std::string &line) {
+        std::ofstream out(lock.lockPath(), std::ios::trunc);
+        out << line << "\n";
+        out.close();
+        return !out.fail() && lock.commit();
+    }
+
+    const PackedRefs *packedRefs() {
+        return packedCache.get(rootDir + "/packed-refs",
+                               [](const std::string &path, PackedRefs &refs) { return refs.load(path); });
+    }
+
+    // (name, first line) of every loose branch file. Directory entries
+    // carry their names, so this opens each file but never stats it.
+    std::vector<std::pair<std::string, std::string>> looseBranches() const {
+        std::vector<std::pair<std::string, std::string>> loose;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(rootDir + "/branches", ec)) {
+            const std::filesystem::path &path = entry.path();
+            if (path.extension() != ".txt") continue;
+            std::ifstream in(path);
+            std::string hash;
+            if (!in.is_open()) continue;
+            trace::count(trace::FilesOpened);
+            std::getline(in, hash);
+            loose.emplace_back(path.stem().string(), hash);
+        }
+        return loose;
+    }
+
+    // What status's parallel walk of the working tree collects; workers
+    // append under the mutex
+    struct WorkTreeScan {
+        std::mutex mutex;
+        std::vector<const IndexEntry*> seen;      // tracked and present
+        std::vector<const IndexEntry*> changed;   // present, but stat doesn't prove it clean
+        std::vector<std::string> untracked;
+    };
+
+    // True if the index tracks anything under `dir`
+    static bool tracksUnder(const StagingIndex &index, const std::string &dir) {
+        std::string prefix = dir + "/";
+        auto it = index.all().lower_bound(prefix);
+        return it != index.all().end() && it->first.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    // True if a directory holds a regular file at any depth
+    static bool containsFile(const std::string &dir) {
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+             it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) break;
+            if (it->is_regular_file(ec)) return true;
+        }
+        return false;
+    }
+
+    // Lists one working-tree directory (relative path, "" for the root),
+    // queueing its subdirectories as further tasks. d_type spares a stat
+    // for everything but tracked files; a directory with nothing tracked
+    // under it isn't entered.
+    void scanDirectory(const StagingIndex &index, const std::string &dir, WorkTreeScan &scan, ThreadPool &pool) {
+        std::string full = dir.empty() ? workDir : workPath(dir);
+        DIR *handle = ::opendir(full.c_str());
+        if (!handle) return;
+        trace::count(trace::FilesOpened);
+
+        std::vector<const IndexEntry*> seen, changed;
+        std::vector<std::string> untracked;
+        while (dirent *entry = ::readdir(handle)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || (dir.empty() && name == ".minigit")) continue;
+            std::string path = dir.empty() ? name : dir + "/" + name;
+
+            // Symlinks count as the file they point to; linked directories
+            // aren't followed
+            unsigned char type = entry->d_type;
+            if (type == DT_LNK || type == DT_UNKNOWN) {
+                struct stat st;
+                trace::count(trace::FileStats);
+                if (::stat(workPath(path).c_str(), &st) != 0) continue;
+                if (S_ISREG(st.st_mode)) type = DT_REG;
+                else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) type = DT_DIR;
+                else continue;
+            }
+
+            if (type == DT_DIR) {
+                if (tracksUnder(index, path)) {
+                    pool.submit([this, &index, &scan, &pool, path] { scanDirectory(index, path, scan, pool); });
+                } else if (containsFile(workPath(path))) {
+                    untracked.push_back(path + "/");
+                }
+                continue;
+            }
+            if (type != DT_REG) continue;
+
+            const IndexEntry *tracked = index.find(path);
+            if (!tracked) {
+                untracked.push_back(std::move(path));
+                continue;
+            }
+            FileStat current;
+            if (!statFile(workPath(path), current)) continue;
+            seen.push_back(tracked);
+            if (!index.isClean(*tracked, current)) changed.push_back(tracked);
+        }
+        ::closedir(handle);
+
+        std::lock_guard<std::mutex> lock(scan.mutex);
+        scan.seen.insert(scan.seen.end(), seen.begin(), seen.end());
+        scan.changed.insert(scan.changed.end(), changed.begin(), changed.end());
+        for (auto &path : untracked) scan.untracked.push_back(std::move(path));
+    }
+
+    // Sketches blobs for rename detection on the worker pool, keeping
+    // them by blob hash so later diffs and merges reuse them
+    similarity::SketchBatch sketchBatch(const ObjectStore &store) {
+        return [this, &store](const std::vector<std::string> &blobs) {
+            trace::Span span("similarity.sketch");
+            std::vector<std::string> missing;
+            for (const auto &blob : blobs) {
+                if (!sketchCache.count(blob)) missing.push_back(blob);
+            }
+            std::sort(missing.begin(), missing.end());
+            missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+            if (sketchCache.size() + missing.size() > MAX_SKETCHES) sketchCache.clear();
+
+            std::vector<similarity::Sketch> computed(missing.size());
+            workers().parallelFor(missing.size(), [&](size_t i) {
+                auto in = store.open(missing[i]);
+                if (in) computed[i] = similarity::sketch(*in);
+            });
+            for (size_t i = 0; i < missing.size(); ++i) sketchCache[missing[i]] = computed[i];
+
+            std::vector<const similarity::Sketch*> out;
+            for (const auto &blob : blobs) out.push_back(&sketchCache[blob]);
+            return out;
+        };
+    }
+
+    struct Rename {
+        std::string oldPath, oldBlob, newPath, newBlob;
+    };
+
+    // Files removed between two trees that reappear, identical or similar,
+    // under a new path
+    std::vector<Rename> findRenames(const ObjectStore &store, const std::string &oldTree, const std::string &newTree) {
+        std::vector<std::pair<std::string, std::string>> removed, added;
+        diffTrees(store, oldTree, newTree,
+                  [&](const std::string &filename, const std::string &oldBlob, const std::string &newBlob) {
+                      if (newBlob.empty()) removed.emplace_back(filename, oldBlob);
+                      else if (oldBlob.empty()) added.emplace_back(filename, newBlob);
+                  });
+        std::vector<Rename> out;
+        if (removed.empty() || added.empty()) return out;
+
+        std::vector<similarity::Source> sources;
+        std::vector<std::string> dests;
+        for (const auto &[path, blob] : removed) sources.push_back({blob, true});
+        for (const auto &[path, blob] : added) dests.push_back(blob);
+        std::vector<similarity::Match> matches =
+            similarity::match(sources, dests, false, similarity::DEFAULT_MIN_SCORE, sketchBatch(store));
+        for (size_t d = 0; d < matches.size(); ++d) {
+            if (matches[d].source == similarity::Match::NONE) continue;
+            const auto &[oldPath, oldBlob] = removed[matches[d].source];
+            out.push_back({oldPath, oldBlob, added[d].first, added[d].second});
+        }
+        return out;
+    }
+
+    // Rewrites a tree diff's added files as renames or copies of removed or
+    // modified ones; the removed side of a rename is dropped
+    void pairRenames(const ObjectStore &store, std::vector<FileDiff> &files) {
+        std::vector<similarity::Source> sources;
+        std::vector<size_t> sourceAt, destAt;
+        std::vector<std::string> dests;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (files[i].oldBlob.empty()) {
+                dests.push_back(files[i].newBlob);
+                destAt.push_back(i);
+            } else {
+                sources.push_back({files[i].oldBlob, files[i].newBlob.empty()});
+                sourceAt.push_back(i);
+            }
+        }
+        if (dests.empty() || sources.empty()) return;
+
+        std::vector<similarity::Match> matches =
+            similarity::match(sources, dests, true, similarity::DEFAULT_MIN_SCORE, sketchBatch(store));
+        std::vector<bool> drop(files.size(), false);
+        for (size_t d = 0; d < matches.size(); ++d) {
+            const similarity::Match &match = matches[d];
+            if (match.source == similarity::Match::NONE) continue;
+            FileDiff &file = files[destAt[d]];
+            const FileDiff &source = files[sourceAt[match.source]];
+            file.oldPath = source.path;
+            file.oldBlob = source.oldBlob;
+            file.similarity = match.score;
+            file.copied = match.copy;
+            if (!match.copy) drop[sourceAt[match.source]] = true;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (drop[i]) continue;
+            if (kept != i) files[kept] = std::move(files[i]);
+            ++kept;
+        }
+        files.resize(kept);
+    }
+
+    // Fills in a file's unified diff, and for a rename or copy replaces the
+    // estimated similarity with the share of lines the diff kept
+    static void writePatch(const ObjectStore &store, FileDiff &file, DiffAlgorithm algorithm) {
+        trace::Span span("diff.file");
+        auto readBlob = [&](const std::string &blob) {
+            std::vector<std::string> lines;
+            if (blob.empty()) return lines;
+            auto in = store.open(blob);
+            if (in) lines = readLines(*in);
+            return lines;
+        };
+        std::ostringstream patch;
+        auto writeHeader = [&] {
+            const char *kind = file.copied ? "copy" : "rename";
+            patch << "similarity index " << file.similarity << "%\n" << kind << " from " << file.oldPath << "\n"
+                  << kind << " to " << file.path << "\n";
+        };
+        if (!file.oldPath.empty() && file.oldBlob == file.newBlob) {
+            file.similarity = 100;
+            writeHeader();
+            file.patch = patch.str();
+            return;
+        }
+
+        std::vector<std::string> lines1 = readBlob(file.oldBlob);
+        std::vector<std::string> lines2 = readBlob(file.newBlob);
+
+        // One interner for both sides, so equal lines get equal IDs
+        LineInterner interner;
+        std::vector<uint32_t> ids1 = interner.internAll(lines1);
+        std::vector<uint32_t> ids2 = interner.internAll(lines2);
+        DiffResult result = diffLines(ids1, ids2, algorithm);
+
+        if (!file.oldPath.empty()) {
+            size_t kept = lines1.size() - std::count(result.deleted.begin(), result.deleted.end(), 1);
+            size_t longer = std::max(lines1.size(), lines2.size());
+            file.similarity = longer ? static_cast<int>(kept * 100 / longer) : 100;
+            writeHeader();
+        }
+        writeUnifiedDiff(patch, file.oldBlob.empty() ? "/dev/null" : "a/" + (file.oldPath.empty() ? file.path : file.oldPath),
+                         file.newBlob.empty() ? "/dev/null" : "b/" + file.path, lines1, lines2, result);
+        file.patch = patch.str();
+    }
+
+    // Hashes a working-tree file without storing it
+    static std::string hashFile(const std::string &filename) {
+        std::ifstream inFile(filename, std::ios::binary);
+        if (!inFile.is_open()) return "";
+        trace::count(trace::FilesOpened);
+
+        SHA1 sha;
+        std::vector<char> chunk(ObjectStore::CHUNK_SIZE);
+        while (inFile.read(chunk.data(), chunk.size()) || inFile.gcount() > 0) {
+            trace::count(trace::BytesRead, static_cast<uint64_t>(inFile.gcount()));
+            sha.update(reinterpret_cast<const uint8_t*>(chunk.data()), static_cast<size_t>(inFile.gcount()));
+        }
+        return sha.final();
+    }
+
+    // A path given relative to the work tree, or absolute, as a normalized
+    // path relative to the work tree ("." for its root). Returns false if
+    // it leads outside the work tree, which no index entry may.
+    bool workTreeRelative(const std::string &path, std::string &relative) const {
+        namespace fs = std::filesystem;
+        fs::path root = fs::absolute(workDir).lexically_normal();
+        if (root.filename().empty() && root.has_relative_path()) root = root.parent_path();
+        fs::path full = fs::path(path).is_absolute() ? fs::path(path) : root / path;
+        fs::path inTree = full.lexically_normal().lexically_relative(root).lexically_normal();
+
+        relative = inTree.generic_string();
+        while (relative.size() > 1 && relative.back() == '/') relative.pop_back();
+        return !relative.empty() && !inTree.is_absolute() && *inTree.begin() != "..";
+    }
+
+    // Expands work-tree paths into a sorted, de-duplicated list of regular
+    // files. Directories are walked recursively, skipping .minigit.
+    std::vector<std::string> collectFiles(const std::vector<std::string> &paths, std::vector<std::string> &missing) const {
+        namespace fs = std::filesystem;
+        std::set<std::string> files;
+
+        for (const auto &path : paths) {
+            std::string full = workPath(path);
+            if (!fs::exists(full)) {
+                missing.push_back(path);
+                continue;
+            }
+
+            if (!fs::is_directory(full)) {
+                files.insert(fs::path(path).lexically_normal().generic_string());
+                continue;
+            }
+
+            std::error_code ec;
+            for (auto it = fs::recursive_directory_iterator(full, ec); it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if (ec) break;
+                if (it->path().filename() == ".minigit") {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                if (it->is_regular_file()) {
+                    fs::path relative = workDir == "." ? it->path() : it->path().lexically_relative(workDir);
+                    files.insert(relative.lexically_normal().generic_string());
+                }
+            }
+        }
+
+        return std::vector<std::string>(files.begin(), files.end());
+    }
+
+    // Index entries at or under any of `paths` whose files no longer exist,
+    // in path order. `files` is what collectFiles found on disk.
+    std::vector<std::string> deletedUnder(const StagingIndex &index, const std::vector<std::string> &paths,
+                                          const std::vector<std::string> &files) const {
+        std::set<std::string> gone;
+        for (const auto &path : paths) {
+            std::string key = trackedKey(path);
+            std::string prefix = key.empty() ? "" : key + "/";
+            for (auto it = index.all().lower_bound(key); it != index.all().end(); ++it) {
+                const std::string &tracked = it->first;
+                if (tracked != key && tracked.compare(0, prefix.size(), prefix) != 0) break;
+                FileStat stat;
+                if (!std::binary_search(files.begin(), files.end(), tracked) && !statFile(workPath(tracked), stat)) {
+                    gone.insert(tracked);
+                }
+            }
+        }
+        return std::vector<std::string>(gone.begin(), gone.end());
+    }
+
+    // True if the index holds `path` or anything under it
+    static bool isTracked(const StagingIndex &index, const std::string &path) {
+        std::string key = trackedKey(path);
+        return key.empty() ? !index.empty() : index.find(key) || tracksUnder(index, key);
+    }
+
+    // An argument as an index path: normalized, without a trailing slash,
+    // and "" for the whole work tree
+    static std::string trackedKey(const std::string &path) {
+        std::string key = std::filesystem::path(path).lexically_normal().generic_string();
+        while (!key.empty() && key.back() == '/') key.pop_back();
+        return key == "." ? "" : key;
+    }
+
+    // Commit files record ctime() output; the graph stores it as epoch
+    // seconds
+    static int64_t parseCommitDate(const std::string &date) {
+        tm parsed{};
+        if (!strptime(date.c_str(), "%a %b %d %H:%M:%S %Y", &parsed)) return 0;
+        parsed.tm_isdst = -1;
+        return static_cast<int64_t>(mktime(&parsed));
+    }
+
+    // Adds a commit whose ref update succeeded to the commit graph and the
+    // Bloom index. Each file is appended to under its lock, and the graph
+    // is re-read there, so a parent another writer only just recorded is
+    // found; if it still isn't, the graph is rebuilt instead.
+    void recordCommit(const ObjectStore &store, const std::string &commitHash, const std::string &parentHash,
+                      const std::string &parentTree, const std::string &treeHash, time_t commitTime) {
+        trace::Span history("commit.graph-and-bloom");
+        std::string graphPath = rootDir + "/commit-graph";
+        bool appended = false;
+        {
+            LockFile graphLock;
+            CommitGraph graph;
+            if (graphLock.acquire(graphPath) && graph.load(graphPath) &&
+                (parentHash == "null" || graph.find(parentHash) != CommitGraph::NONE)) {
+                CommitGraph::Record record{commitHash, CommitGraph::NONE, 1, static_cast<int64_t>(commitTime)};
+                if (parentHash != "null") {
+                    record.parent = graph.find(parentHash);
+                    record.generation = graph.generation(record.parent) + 1;
+                }
+                appended = CommitGraph::append(graphPath, record);
+            }
+        }
+        if (!appended) rebuildCommitGraph();
+
+        // Record which paths changed for path-limited log. Without the
+        // lock the commit gets no filter, which log treats as "maybe".
+        std::vector<std::string> changedPaths;
+        diffTrees(store, parentTree, treeHash,
+                  [&](const std::string &path, const std::string &, const std::string &) { changedPaths.push_back(path); });
+        std::string bloomPath = rootDir + "/commit-bloom";
+        LockFile bloomLock;
+        if (bloomLock.acquire(bloomPath)) BloomIndex::append(bloomPath, commitHash, ChangedPathFilter(changedPaths));
+    }
+
+    // Rebuilds .minigit/commit-graph from every file in commits/. Used when
+    // the graph is missing or predates commits made by an older build.
+    bool rebuildCommitGraph() {
+        struct Info {
+            std::string parent = "null";
+            int64_t timestamp = 0;
+            uint32_t generation = 0;
+        };
+        std::map<std::string, Info> commits;
+
+        for (const auto &entry : std::filesystem::directory_iterator(rootDir + "/commits")) {
+            if (entry.path().extension() != ".txt") continue;
+            Info info;
+            CommitFile commit;
+            if (!commit.open(entry.path().string())) continue;
+            if (!commit.parent().empty()) info.parent = std::string(commit.parent());
+            info.timestamp = parseCommitDate(std::string(commit.date()));
+            commits[entry.path().stem().string()] = info;
+        }
+
+        // Generation numbers, walking each unresolved chain down to a known one
+        for (auto &[hash, info] : commits) {
+            std::vector<Info*> pending;
+            Info *walker = &info;
+            while (walker->generation == 0) {
+                pending.push_back(walker);
+                auto parent = commits.find(walker->parent);
+                if (parent == commits.end()) break;
+                walker = &parent->second;
+            }
+            uint32_t generation = walker->generation;
+            for (auto it = pending.rbegin(); it != pending.rend(); ++it) (*it)->generation = ++generation;
+        }
+
+        std::vector<std::pair<uint32_t, std::string>> order;
+        for (const auto &[hash, info] : commits) order.emplace_back(info.generation, hash);
+        std::sort(order.begin(), order.end());
+
+        std::map<std::string, uint32_t> position;
+        std::vector<CommitGraph::Record> records;
+        for (const auto &[generation, hash] : order) {
+            const Info &info = commits[hash];
+            auto parent = position.find(info.parent);
+            records.push_back({hash, parent == position.end() ? CommitGraph::NONE : parent->second, generation, info.timestamp});
+            position[hash] = static_cast<uint32_t>(records.size() - 1);
+        }
+        return CommitGraph::write(rootDir + "/commit-graph", records);
+    }
+
+    // Loads the commit graph, rebuilding it if it is missing or doesn't know
+    // one of the given commits
+    bool openCommitGraph(CommitGraph &graph, const std::vector<std::string> &tips) {
+        std::string graphPath = rootDir + "/commit-graph";
+        bool usable = graph.load(graphPath);
+        for (size_t i = 0; usable && i < tips.size(); ++i) {
+            if (tips[i] != "null" && graph.find(tips[i]) == CommitGraph::NONE) usable = false;
+        }
+        if (usable) return true;
+        return rebuildCommitGraph() && graph.load(graphPath);
+    }
+};
+
+#endif // REPOSITORY_H
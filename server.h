@@ -0,0 +1,115 @@
+// server.h
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <functional>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// ---------------------
+// Line server
+// ---------------------
+// Serves a line protocol on a Unix domain socket: each line a client sends
+// is passed to the handler, and the handler's reply is written back
+// followed by a newline. Clients are served one at a time in arrival order,
+// so handlers never run concurrently and can share state freely.
+//
+// handle(line, stop) returns the reply; setting stop makes serveLines
+// return once the reply is sent.
+using LineHandler = std::function<std::string(const std::string &, bool &)>;
+
+namespace server_detail {
+
+inline bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Handles one connection until the client hangs up or asks to stop
+inline bool serveClient(int fd, const LineHandler &handle) {
+    std::string pending;
+    char buf[4096];
+    for (;;) {
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+
+            bool stop = false;
+            if (!sendAll(fd, handle(line, stop) + "\n")) return stop;
+            if (stop) return true;
+        }
+
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        pending.append(buf, static_cast<size_t>(n));
+    }
+}
+
+} // namespace server_detail
+
+// Returns false with `error` set if the socket can't be set up; otherwise
+// serves until a handler sets stop, then removes the socket file.
+inline bool serveLines(const std::string &socketPath, const LineHandler &handle, std::string &error) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        error = "socket path too long";
+        return false;
+    }
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+
+    // A socket file left by a daemon that died is stale; one that still
+    // accepts connections belongs to a running daemon
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool running = probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (probe >= 0) ::close(probe);
+    if (running) {
+        ::close(listener);
+        error = "a daemon is already listening on " + socketPath;
+        return false;
+    }
+    ::unlink(socketPath.c_str());
+
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, 16) != 0) {
+        error = std::strerror(errno);
+        ::close(listener);
+        return false;
+    }
+
+    bool stop = false;
+    while (!stop) {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            error = std::strerror(errno);
+            break;
+        }
+        stop = server_detail::serveClient(client, handle);
+        ::close(client);
+    }
+
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+    return stop;
+}
+
+#endif // SERVER_H
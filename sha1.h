@@ -3,46 +3,135 @@
 #define SHA1_H
 
 #include <string>
-#include <sstream>
-#include <iomanip>
+#include <string_view>
+#include <vector>
 #include <cstring>
+#include <cstdint>
+#include "trace.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SHA1_HAVE_SHANI 1
+#include <immintrin.h>
+#endif
 
 class SHA1 {
 public:
-    SHA1() { reset(); }
+    // Block compression kernels. Both consume whole 64-byte blocks and
+    // update the five-word state in place.
+    enum class Kernel { Portable, ShaNi };
+    using BlockFn = void (*)(uint32_t state[5], const uint8_t *data, size_t blocks);
+
+    SHA1() : compress(activeKernel()) { reset(); }
+    explicit SHA1(Kernel kernel) : compress(kernelFn(kernel)) { reset(); }
 
     void update(const std::string &s) {
-        update(reinterpret_cast<const uint8_t*>(s.c_str()), s.size());
+        update(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+    }
+
+    void update(std::string_view s) {
+        update(reinterpret_cast<const uint8_t*>(s.data()), s.size());
     }
 
     void update(const uint8_t *data, size_t len) {
-        for (size_t i = 0; i < len; ++i) {
-            dataBuffer[bufferIndex++] = data[i];
-            messageLength += 8;
+        trace::count(trace::BytesHashed, len);
+        messageLength += static_cast<uint64_t>(len) * 8;
 
-            if (bufferIndex == 64) {
-                processBlock(dataBuffer);
-                bufferIndex = 0;
-            }
+        // Top up a partially filled block first
+        if (bufferIndex > 0) {
+            size_t take = std::min(len, 64 - bufferIndex);
+            std::memcpy(dataBuffer + bufferIndex, data, take);
+            bufferIndex += take;
+            data += take;
+            len -= take;
+            if (bufferIndex < 64) return;
+            compress(digest, dataBuffer, 1);
+            bufferIndex = 0;
+        }
+
+        // Hash whole blocks straight from the caller's buffer
+        size_t blocks = len / 64;
+        if (blocks > 0) {
+            compress(digest, data, blocks);
+            data += blocks * 64;
+            len -= blocks * 64;
+        }
+
+        if (len > 0) {
+            std::memcpy(dataBuffer, data, len);
+            bufferIndex = len;
         }
     }
 
     std::string final() {
-        dataBuffer[bufferIndex++] = 0x80;
-        if (bufferIndex > 56) {
-            while (bufferIndex < 64) dataBuffer[bufferIndex++] = 0x00;
-            processBlock(dataBuffer);
-            bufferIndex = 0;
-        }
-        while (bufferIndex < 56) dataBuffer[bufferIndex++] = 0x00;
+        uint8_t tail[128];
+        size_t tailBlocks = padTail(tail, dataBuffer, bufferIndex, messageLength);
+        compress(digest, tail, tailBlocks);
+
+        std::string result = toHex(digest);
+        reset();
+        return result;
+    }
+
+    // Kernel selection. SHA-NI is used when the CPU advertises the SHA
+    // extensions; everything else falls back to the portable code.
+    static bool kernelSupported(Kernel kernel) {
+        if (kernel == Kernel::Portable) return true;
+#ifdef SHA1_HAVE_SHANI
+        static const bool hasShaNi = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+        return hasShaNi;
+#else
+        return false;
+#endif
+    }
+
+    static const char *kernelName(Kernel kernel) {
+        return kernel == Kernel::ShaNi ? "sha-ni" : "portable";
+    }
+
+    static Kernel bestKernel() {
+        return kernelSupported(Kernel::ShaNi) ? Kernel::ShaNi : Kernel::Portable;
+    }
+
+    static BlockFn kernelFn(Kernel kernel) {
+#ifdef SHA1_HAVE_SHANI
+        if (kernel == Kernel::ShaNi && kernelSupported(Kernel::ShaNi)) return compressShaNi;
+#endif
+        (void)kernel;
+        return compressPortable;
+    }
 
-        for (int i = 7; i >= 0; --i) dataBuffer[bufferIndex++] = (messageLength >> (i * 8)) & 0xFF;
-        processBlock(dataBuffer);
+    static BlockFn activeKernel() {
+        static const BlockFn fn = kernelFn(bestKernel());
+        return fn;
+    }
+
+    // Writes the 0x80 terminator, zero padding and big-endian bit length
+    // after the final partial block. Returns the number of tail blocks (1 or 2).
+    static size_t padTail(uint8_t out[128], const uint8_t *partial, size_t partialLen, uint64_t bitLength) {
+        std::memcpy(out, partial, partialLen);
+        out[partialLen] = 0x80;
+        size_t total = partialLen + 1 > 56 ? 128 : 64;
+        std::memset(out + partialLen + 1, 0, total - partialLen - 1);
+        for (int i = 0; i < 8; ++i)
+            out[total - 1 - i] = static_cast<uint8_t>(bitLength >> (i * 8));
+        return total / 64;
+    }
 
-        std::ostringstream result;
+    static std::string toHex(const uint32_t state[5]) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex(40, '0');
         for (int i = 0; i < 5; ++i)
-            result << std::hex << std::setw(8) << std::setfill('0') << digest[i];
-        return result.str();
+            for (int j = 0; j < 8; ++j)
+                hex[i * 8 + j] = digits[(state[i] >> (28 - j * 4)) & 0xF];
+        return hex;
+    }
+
+    static void initState(uint32_t state[5]) {
+        state[0] = 0x67452301;
+        state[1] = 0xEFCDAB89;
+        state[2] = 0x98BADCFE;
+        state[3] = 0x10325476;
+        state[4] = 0xC3D2E1F0;
     }
 
 private:
@@ -50,66 +139,320 @@ private:
     uint8_t dataBuffer[64];
     size_t bufferIndex = 0;
     uint64_t messageLength = 0;
+    BlockFn compress;
 
     void reset() {
-        digest[0] = 0x67452301;
-        digest[1] = 0xEFCDAB89;
-        digest[2] = 0x98BADCFE;
-        digest[3] = 0x10325476;
-        digest[4] = 0xC3D2E1F0;
+        initState(digest);
         bufferIndex = 0;
         messageLength = 0;
     }
 
-    void processBlock(const uint8_t *block) {
-        uint32_t w[80];
-        for (int i = 0; i < 16; ++i) {
-            w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    static uint32_t rol(uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    static void compressPortable(uint32_t state[5], const uint8_t *block, size_t blocks) {
+        for (; blocks > 0; --blocks, block += 64) {
+            uint32_t w[80];
+            for (int i = 0; i < 16; ++i) {
+                w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16) |
+                       (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+            }
+            for (int i = 16; i < 80; ++i) {
+                w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+            }
+
+            uint32_t a = state[0];
+            uint32_t b = state[1];
+            uint32_t c = state[2];
+            uint32_t d = state[3];
+            uint32_t e = state[4];
+
+            // Split by round group so the round function isn't branched on
+            // eighty times per block
+            auto round = [&](uint32_t f, uint32_t k, uint32_t wi) {
+                uint32_t temp = rol(a, 5) + f + e + k + wi;
+                e = d;
+                d = c;
+                c = rol(b, 30);
+                b = a;
+                a = temp;
+            };
+            for (int i = 0; i < 20; ++i) round((b & c) | ((~b) & d), 0x5A827999, w[i]);
+            for (int i = 20; i < 40; ++i) round(b ^ c ^ d, 0x6ED9EBA1, w[i]);
+            for (int i = 40; i < 60; ++i) round((b & c) | (b & d) | (c & d), 0x8F1BBCDC, w[i]);
+            for (int i = 60; i < 80; ++i) round(b ^ c ^ d, 0xCA62C1D6, w[i]);
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+        }
+    }
+
+#ifdef SHA1_HAVE_SHANI
+    // Four rounds with the SHA extensions. E0/E1 alternate as the rotating
+    // E accumulator and MSG* hold the rolling message schedule.
+#define SHA1_NI_ROUNDS(ABCD, EIN, EOUT, FUNC, M0, M1, M2, M3)  \
+    EIN = _mm_sha1nexte_epu32(EIN, M1);                           \
+    EOUT = ABCD;                                                  \
+    M2 = _mm_sha1msg2_epu32(M2, M1);                              \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, EIN, FUNC);                  \
+    M0 = _mm_sha1msg1_epu32(M0, M1);                              \
+    M3 = _mm_xor_si128(M3, M1);
+
+    __attribute__((target("sha,sse4.1")))
+    static void compressShaNi(uint32_t state[5], const uint8_t *data, size_t blocks) {
+        const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+        __m128i abcd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+        __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+        abcd = _mm_shuffle_epi32(abcd, 0x1B);
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const __m128i abcdSave = abcd;
+            const __m128i e0Save = e0;
+            __m128i e1;
+
+            // Rounds 0-15 load the block itself
+            __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), mask);
+            e0 = _mm_add_epi32(e0, m0);
+            e1 = abcd;
+            abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+            __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), mask);
+            e1 = _mm_sha1nexte_epu32(e1, m1);
+            e0 = abcd;
+            abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+            m0 = _mm_sha1msg1_epu32(m0, m1);
+
+            __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)), mask);
+            e0 = _mm_sha1nexte_epu32(e0, m2);
+            e1 = abcd;
+            abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+            m1 = _mm_sha1msg1_epu32(m1, m2);
+            m0 = _mm_xor_si128(m0, m2);
+
+            __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), mask);
+            e1 = _mm_sha1nexte_epu32(e1, m3);
+            e0 = abcd;
+            m0 = _mm_sha1msg2_epu32(m0, m3);
+            abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+            m2 = _mm_sha1msg1_epu32(m2, m3);
+            m1 = _mm_xor_si128(m1, m3);
+
+            // Rounds 16-67 follow a fixed four-register rotation
+            SHA1_NI_ROUNDS(abcd, e0, e1, 0, m3, m0, m1, m2)   // 16-19
+            SHA1_NI_ROUNDS(abcd, e1, e0, 1, m0, m1, m2, m3)   // 20-23
+            SHA1_NI_ROUNDS(abcd, e0, e1, 1, m1, m2, m3, m0)   // 24-27
+            SHA1_NI_ROUNDS(abcd, e1, e0, 1, m2, m3, m0, m1)   // 28-31
+            SHA1_NI_ROUNDS(abcd, e0, e1, 1, m3, m0, m1, m2)   // 32-35
+            SHA1_NI_ROUNDS(abcd, e1, e0, 1, m0, m1, m2, m3)   // 36-39
+            SHA1_NI_ROUNDS(abcd, e0, e1, 2, m1, m2, m3, m0)   // 40-43
+            SHA1_NI_ROUNDS(abcd, e1, e0, 2, m2, m3, m0, m1)   // 44-47
+            SHA1_NI_ROUNDS(abcd, e0, e1, 2, m3, m0, m1, m2)   // 48-51
+            SHA1_NI_ROUNDS(abcd, e1, e0, 2, m0, m1, m2, m3)   // 52-55
+            SHA1_NI_ROUNDS(abcd, e0, e1, 2, m1, m2, m3, m0)   // 56-59
+            SHA1_NI_ROUNDS(abcd, e1, e0, 3, m2, m3, m0, m1)   // 60-63
+            SHA1_NI_ROUNDS(abcd, e0, e1, 3, m3, m0, m1, m2)   // 64-67
+
+            // Rounds 68-79 drain the schedule
+            e1 = _mm_sha1nexte_epu32(e1, m1);
+            e0 = abcd;
+            m2 = _mm_sha1msg2_epu32(m2, m1);
+            abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+            m3 = _mm_xor_si128(m3, m1);
+
+            e0 = _mm_sha1nexte_epu32(e0, m2);
+            e1 = abcd;
+            m3 = _mm_sha1msg2_epu32(m3, m2);
+            abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+            e1 = _mm_sha1nexte_epu32(e1, m3);
+            e0 = abcd;
+            abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+            e0 = _mm_sha1nexte_epu32(e0, e0Save);
+            abcd = _mm_add_epi32(abcd, abcdSave);
+        }
+
+        abcd = _mm_shuffle_epi32(abcd, 0x1B);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), abcd);
+        state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+    }
+#undef SHA1_NI_ROUNDS
+#endif
+};
+
+// ---------------------
+// Multi-buffer hashing
+// ---------------------
+// Hashes several independent inputs in lockstep, four lanes at a time,
+// using portable vector extensions (SSE2 on x86-64, NEON on ARM). When
+// SHA-NI is available a single lane is already faster than four portable
+// lanes, so inputs are simply hashed back to back with it.
+namespace sha1_detail {
+
+typedef uint32_t Lanes __attribute__((vector_size(16)));
+constexpr int kLanes = 4;
+
+inline Lanes rolLanes(Lanes v, int bits) {
+    return (v << bits) | (v >> (32 - bits));
+}
+
+inline void compressLanes(Lanes state[5], const uint8_t *const blocks[kLanes]) {
+    Lanes w[16];
+    for (int i = 0; i < 16; ++i) {
+        for (int lane = 0; lane < kLanes; ++lane) {
+            const uint8_t *p = blocks[lane] + i * 4;
+            w[i][lane] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+    }
+
+    Lanes a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        Lanes wi;
+        if (i < 16) {
+            wi = w[i];
+        } else {
+            wi = rolLanes(w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15], 1);
+            w[i & 15] = wi;
+        }
+
+        Lanes f;
+        uint32_t k;
+        if (i < 20)      { f = (b & c) | (~b & d);         k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                  k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                  k = 0xCA62C1D6; }
+
+        Lanes temp = rolLanes(a, 5) + f + e + k + wi;
+        e = d;
+        d = c;
+        c = rolLanes(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+} // namespace sha1_detail
+
+inline std::vector<std::string> sha1Multi(const std::vector<std::string_view> &inputs,
+                                          bool allowShaNi = true) {
+    using namespace sha1_detail;
+    std::vector<std::string> results(inputs.size());
+
+    if (allowShaNi && SHA1::kernelSupported(SHA1::Kernel::ShaNi)) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            SHA1 sha(SHA1::Kernel::ShaNi);
+            sha.update(inputs[i]);
+            results[i] = sha.final();
         }
-        for (int i = 16; i < 80; ++i) {
-            w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+        return results;
+    }
+
+    if (trace::enabled()) {
+        for (auto input : inputs) trace::count(trace::BytesHashed, input.size());
+    }
+
+    struct Lane {
+        size_t input = 0;
+        const uint8_t *data = nullptr;
+        size_t fullBlocks = 0;
+        size_t tailBlocks = 0;
+        size_t next = 0;
+        bool active = false;
+        uint8_t tail[128];
+    };
+
+    Lane lanes[kLanes];
+    Lanes state[5];
+    uint32_t initial[5];
+    SHA1::initState(initial);
+    static const uint8_t idleBlock[64] = {};
+    size_t nextInput = 0;
+
+    auto load = [&](int l) {
+        Lane &lane = lanes[l];
+        lane.active = false;
+        if (nextInput >= inputs.size()) return;
+        std::string_view in = inputs[nextInput];
+        lane.input = nextInput++;
+        lane.data = reinterpret_cast<const uint8_t*>(in.data());
+        lane.fullBlocks = in.size() / 64;
+        lane.tailBlocks = SHA1::padTail(lane.tail, lane.data + lane.fullBlocks * 64,
+                                        in.size() % 64, static_cast<uint64_t>(in.size()) * 8);
+        lane.next = 0;
+        lane.active = true;
+        for (int i = 0; i < 5; ++i) state[i][l] = initial[i];
+    };
+
+    for (int l = 0; l < kLanes; ++l) load(l);
+
+    for (;;) {
+        const uint8_t *blocks[kLanes];
+        bool any = false;
+        for (int l = 0; l < kLanes; ++l) {
+            Lane &lane = lanes[l];
+            if (!lane.active) {
+                blocks[l] = idleBlock;
+                continue;
+            }
+            any = true;
+            blocks[l] = lane.next < lane.fullBlocks
+                ? lane.data + lane.next * 64
+                : lane.tail + (lane.next - lane.fullBlocks) * 64;
         }
+        if (!any) break;
 
-        uint32_t a = digest[0];
-        uint32_t b = digest[1];
-        uint32_t c = digest[2];
-        uint32_t d = digest[3];
-        uint32_t e = digest[4];
-
-        for (int i = 0; i < 80; ++i) {
-            uint32_t f, k;
-            if (i < 20) {
-                f = (b & c) | ((~b) & d);
-                k = 0x5A827999;
-            } else if (i < 40) {
-                f = b ^ c ^ d;
-                k = 0x6ED9EBA1;
-            } else if (i < 60) {
-                f = (b & c) | (b & d) | (c & d);
-                k = 0x8F1BBCDC;
-            } else {
-                f = b ^ c ^ d;
-                k = 0xCA62C1D6;
+        compressLanes(state, blocks);
+
+        for (int l = 0; l < kLanes; ++l) {
+            Lane &lane = lanes[l];
+            if (!lane.active) continue;
+            if (++lane.next == lane.fullBlocks + lane.tailBlocks) {
+                uint32_t digest[5];
+                for (int i = 0; i < 5; ++i) digest[i] = state[i][l];
+                results[lane.input] = SHA1::toHex(digest);
+                load(l);
             }
-            uint32_t temp = rol(a, 5) + f + e + k + w[i];
-            e = d;
-            d = c;
-            c = rol(b, 30);
-            b = a;
-            a = temp;
         }
+    }
 
-        digest[0] += a;
-        digest[1] += b;
-        digest[2] += c;
-        digest[3] += d;
-        digest[4] += e;
+    return results;
+}
+
+// Conversions between the 40-char hex form used in file names and the
+// 20-byte raw form used in binary files
+inline std::string hexFromRaw(const uint8_t raw[20]) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(40, '0');
+    for (int i = 0; i < 20; ++i) {
+        hex[i * 2] = digits[raw[i] >> 4];
+        hex[i * 2 + 1] = digits[raw[i] & 0xF];
     }
+    return hex;
+}
 
-    uint32_t rol(uint32_t value, int bits) {
-        return (value << bits) | (value >> (32 - bits));
+inline void rawFromHex(const std::string &hex, uint8_t raw[20]) {
+    auto nibble = [](char c) -> uint8_t {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return 0;
+    };
+    for (int i = 0; i < 20; ++i) {
+        size_t at = static_cast<size_t>(i) * 2;
+        raw[i] = at + 1 < hex.size() ? static_cast<uint8_t>((nibble(hex[at]) << 4) | nibble(hex[at + 1])) : 0;
     }
-};
+}
 
 inline std::string sha1(const std::string &s) {
     SHA1 sha;
@@ -0,0 +1,207 @@
+// similarity.h
+#ifndef SIMILARITY_H
+#define SIMILARITY_H
+
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <istream>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+// ---------------------
+// Rename and copy detection
+// ---------------------
+// Two files are similar when they share most of their distinct lines.
+// A MinHash sketch estimates that share (the Jaccard similarity of the
+// line sets) from SKETCH_SIZE numbers per file. Each line is hashed once;
+// the top bits pick one of SKETCH_SIZE bins and each bin keeps its
+// smallest hash (one-permutation MinHash), and an empty bin borrows from
+// the next non-empty one so short files still fill every slot. Two
+// sketches agree in a slot with probability close to the similarity, so
+// the fraction of equal slots is the estimate, and a sketch never has to
+// be rebuilt once its blob is known.
+//
+// Finding candidates uses locality-sensitive hashing: the sketch is split
+// into BANDS bands of ROWS slots, and files that agree on a whole band
+// share a bucket. A pair of similarity s shares some bucket with
+// probability 1 - (1 - s^ROWS)^BANDS, about 0.99 at 70% and 0.01 at 20%,
+// so only plausible pairs are ever scored, not every added file against
+// every removed one.
+namespace similarity {
+
+constexpr int SKETCH_BITS = 6;
+constexpr size_t SKETCH_SIZE = size_t(1) << SKETCH_BITS;
+constexpr size_t BANDS = 16;
+constexpr size_t ROWS = SKETCH_SIZE / BANDS;
+constexpr int DEFAULT_MIN_SCORE = 50;
+
+// Buckets shared by more sources than this (boilerplate every file
+// carries) are skipped; the other bands still pair real matches
+constexpr size_t MAX_BUCKET = 256;
+
+struct Sketch {
+    std::array<uint64_t, SKETCH_SIZE> mins;
+    size_t lines = 0;
+};
+
+inline uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Sketch of a blob's lines; an empty blob has lines == 0 and is only ever
+// matched by identical hash
+inline Sketch sketch(std::istream &in) {
+    std::array<uint64_t, SKETCH_SIZE> bins;
+    bins.fill(UINT64_MAX);
+
+    Sketch out;
+    std::string line;
+    while (std::getline(in, line)) {
+        ++out.lines;
+        uint64_t hash = mix(std::hash<std::string_view>()(line));
+        uint64_t &bin = bins[hash >> (64 - SKETCH_BITS)];
+        if (hash < bin) bin = hash;
+    }
+
+    // Densify: an empty bin takes the value of the next filled bin to its
+    // right, offset by the distance, so equal line sets fill equally
+    out.mins = bins;
+    if (out.lines == 0) return out;
+    for (size_t k = 0; k < SKETCH_SIZE; ++k) {
+        if (bins[k] != UINT64_MAX) continue;
+        size_t distance = 1;
+        while (bins[(k + distance) % SKETCH_SIZE] == UINT64_MAX) ++distance;
+        out.mins[k] = mix(bins[(k + distance) % SKETCH_SIZE] + distance);
+    }
+    return out;
+}
+
+// Estimated percentage of shared lines
+inline int score(const Sketch &a, const Sketch &b) {
+    if (a.lines == 0 || b.lines == 0) return 0;
+    size_t equal = 0;
+    for (size_t k = 0; k < SKETCH_SIZE; ++k) equal += a.mins[k] == b.mins[k];
+    return static_cast<int>(equal * 100 / SKETCH_SIZE);
+}
+
+struct Source {
+    std::string blob;
+    bool removed;   // gone on the new side: can be renamed, not just copied
+};
+
+struct Match {
+    static constexpr size_t NONE = SIZE_MAX;
+    size_t source = NONE;
+    int score = 0;
+    bool copy = false;
+};
+
+// Returns the sketches of `blobs`, in order, valid until the next call
+using SketchBatch = std::function<std::vector<const Sketch*>(const std::vector<std::string> &)>;
+
+// Picks a source for each destination blob (an added file). A removed
+// source becomes a rename of its best destination; with `copies`, any
+// other destination it or a kept source matches is a copy. Identical
+// blobs are paired by hash first, so pure moves never need a sketch.
+// Ties go to the earliest source and destination, so results don't
+// depend on hash map order.
+inline std::vector<Match> match(const std::vector<Source> &sources, const std::vector<std::string> &dests,
+                                bool copies, int minScore, const SketchBatch &sketchAll) {
+    std::vector<Match> out(dests.size());
+    std::vector<bool> renamed(sources.size(), false);
+
+    // 1. Exact: same blob hash
+    std::unordered_map<std::string_view, std::vector<size_t>> byBlob;
+    for (size_t i = 0; i < sources.size(); ++i) byBlob[sources[i].blob].push_back(i);
+    for (size_t d = 0; d < dests.size(); ++d) {
+        auto found = byBlob.find(dests[d]);
+        if (found == byBlob.end()) continue;
+        for (size_t s : found->second) {
+            if (sources[s].removed && !renamed[s]) {
+                renamed[s] = true;
+                out[d] = {s, 100, false};
+                break;
+            }
+        }
+        if (out[d].source == Match::NONE && copies) out[d] = {found->second.front(), 100, true};
+    }
+
+    // 2. Similar: LSH candidates from the sources still in play, scored
+    // by sketch
+    std::vector<size_t> openSources, openDests;
+    for (size_t s = 0; s < sources.size(); ++s) {
+        if (copies || (sources[s].removed && !renamed[s])) openSources.push_back(s);
+    }
+    for (size_t d = 0; d < dests.size(); ++d) {
+        if (out[d].source == Match::NONE) openDests.push_back(d);
+    }
+    if (openSources.empty() || openDests.empty()) return out;
+
+    std::vector<std::string> blobs;
+    for (size_t s : openSources) blobs.push_back(sources[s].blob);
+    for (size_t d : openDests) blobs.push_back(dests[d]);
+    std::vector<const Sketch*> sketches = sketchAll(blobs);
+    const Sketch *const *sourceSketches = sketches.data();
+    const Sketch *const *destSketches = sketches.data() + openSources.size();
+
+    auto bandKey = [](const Sketch &sketch, size_t band) {
+        uint64_t key = mix(band + 1);
+        for (size_t r = 0; r < ROWS; ++r) key = mix(key ^ sketch.mins[band * ROWS + r]);
+        return key;
+    };
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    for (size_t i = 0; i < openSources.size(); ++i) {
+        if (sourceSketches[i]->lines == 0) continue;
+        for (size_t band = 0; band < BANDS; ++band) {
+            buckets[bandKey(*sourceSketches[i], band)].push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    struct Pair {
+        int score;
+        size_t source, dest;
+    };
+    std::vector<Pair> pairs;
+    std::vector<size_t> seenBy(openSources.size(), SIZE_MAX);
+    for (size_t j = 0; j < openDests.size(); ++j) {
+        if (destSketches[j]->lines == 0) continue;
+        for (size_t band = 0; band < BANDS; ++band) {
+            auto bucket = buckets.find(bandKey(*destSketches[j], band));
+            if (bucket == buckets.end() || bucket->second.size() > MAX_BUCKET) continue;
+            for (uint32_t i : bucket->second) {
+                if (seenBy[i] == j) continue;
+                seenBy[i] = j;
+                int value = score(*sourceSketches[i], *destSketches[j]);
+                if (value >= minScore) pairs.push_back({value, openSources[i], openDests[j]});
+            }
+        }
+    }
+
+    // Best pairs first; each destination takes the first pair it appears in
+    std::sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b) {
+        if (a.score != b.score) return a.score > b.score;
+        if (a.source != b.source) return a.source < b.source;
+        return a.dest < b.dest;
+    });
+    for (const auto &pair : pairs) {
+        Match &result = out[pair.dest];
+        if (result.source != Match::NONE) continue;
+        if (sources[pair.source].removed && !renamed[pair.source]) {
+            renamed[pair.source] = true;
+            result = {pair.source, pair.score, false};
+        } else if (copies) {
+            result = {pair.source, pair.score, true};
+        }
+    }
+    return out;
+}
+
+} // namespace similarity
+
+#endif // SIMILARITY_H
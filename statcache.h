@@ -0,0 +1,96 @@
+// statcache.h
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+#include <sys/stat.h>
+#include "trace.h"
+
+// ---------------------
+// Stat-validated caches
+// ---------------------
+// Identity of a file's current contents as far as stat can tell. A rename
+// over the file changes the inode; an in-place rewrite changes the mtime
+// and ctime.
+//
+// File timestamps come from a coarse kernel clock, so two rewrites of the
+// same size in one tick leave identical stamps. A stamp only identifies
+// contents once the file has gone unchanged for longer than that tick.
+struct FileStamp {
+    static constexpr int64_t RACY_WINDOW_NS = 50000000;  // 50 ms
+
+    bool exists = false;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    int64_t ctimeNs = 0;
+    uint64_t inode = 0;
+
+    static FileStamp of(const std::string &path) {
+        trace::count(trace::FileStats);
+        FileStamp stamp;
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) return stamp;
+        stamp.exists = true;
+        stamp.size = static_cast<uint64_t>(st.st_size);
+        stamp.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        stamp.ctimeNs = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+        stamp.inode = static_cast<uint64_t>(st.st_ino);
+        return stamp;
+    }
+
+    static int64_t nowNs() {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    // True if a later write could not share this stamp; `takenNs` is the
+    // time just before the stat
+    bool settled(int64_t takenNs) const { return ctimeNs + RACY_WINDOW_NS < takenNs && mtimeNs + RACY_WINDOW_NS < takenNs; }
+
+    bool operator==(const FileStamp &o) const {
+        return exists == o.exists && size == o.size && mtimeNs == o.mtimeNs && ctimeNs == o.ctimeNs && inode == o.inode;
+    }
+    bool operator!=(const FileStamp &o) const { return !(*this == o); }
+};
+
+// Values parsed from files, handed back for as long as the file's stamp is
+// unchanged. The stamp is taken before loading, so a write racing with the
+// load can only cause an extra reload, never a stale hit. Files modified
+// too recently to be told apart by stamp are reloaded every time.
+template <typename T>
+class FileCache {
+public:
+    // load(path, value) fills value and returns false if the file is
+    // unusable. Returns nullptr for a missing or unusable file.
+    template <typename Load>
+    const T *get(const std::string &path, Load load) {
+        int64_t takenNs = FileStamp::nowNs();
+        FileStamp stamp = FileStamp::of(path);
+        auto it = entries.find(path);
+        if (it != entries.end() && it->second.settled && it->second.stamp == stamp) {
+            return it->second.valid ? &it->second.value : nullptr;
+        }
+
+        Entry &entry = entries[path];
+        entry.stamp = stamp;
+        entry.settled = stamp.settled(takenNs);
+        entry.value = T();
+        entry.valid = stamp.exists && load(path, entry.value);
+        return entry.valid ? &entry.value : nullptr;
+    }
+
+private:
+    struct Entry {
+        FileStamp stamp;
+        T value;
+        bool valid = false;
+        bool settled = false;
+    };
+    std::unordered_map<std::string, Entry> entries;
+};
+
+#endif // STATCACHE_H
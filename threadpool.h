@@ -0,0 +1,145 @@
+// threadpool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a deque: it pops its own work
+// from the back and, when that runs dry, steals from the front of the other
+// workers' deques. Tasks submitted from outside the pool are dealt
+// round-robin across the deques.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    void submit(std::function<void()> task) {
+        size_t target = (currentPool == this) ? currentWorker : nextQueue++ % queues.size();
+        pending++;
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every submitted task has finished. Rethrows the first
+    // exception a task raised, if any.
+    void wait() {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        idle.wait(lock, [this] { return pending == 0; });
+        if (firstError) {
+            std::exception_ptr error = firstError;
+            firstError = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Runs fn(i) for every i in [0, count) and waits for all of them
+    template <typename Fn>
+    void parallelFor(size_t count, Fn fn) {
+        for (size_t i = 0; i < count; ++i) submit([fn, i] { fn(i); });
+        wait();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> nextQueue{0};
+    std::exception_ptr firstError;
+    bool stopping = false;
+
+    static inline thread_local ThreadPool* currentPool = nullptr;
+    static inline thread_local size_t currentWorker = 0;
+
+    bool tryTake(size_t self, std::function<void()>& task) {
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t step = 1; step < queues.size(); ++step) {
+            Queue& victim = *queues[(self + step) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t self) {
+        currentPool = this;
+        currentWorker = self;
+
+        for (;;) {
+            std::function<void()> task;
+            if (tryTake(self, task)) {
+                queued--;
+                try {
+                    task();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    if (!firstError) firstError = std::current_exception();
+                }
+                if (--pending == 0) {
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    idle.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+        }
+    }
+};
+
+#endif // THREADPOOL_H
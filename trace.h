@@ -0,0 +1,160 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+
+// ---------------------
+// Tracing and counters
+// ---------------------
+// Wall time per phase (Span) and I/O counters (count) for one process.
+// Everything is gated on a single relaxed atomic flag, so with tracing off
+// a Span costs one load and a branch, and a counter the same; it stays
+// compiled into release builds. Turn it on with start() before the work
+// and print with writeSummary() or writeChromeTrace() after.
+//
+// Spans nest and overlap, so phase times are inclusive and don't add up
+// to the command's total.
+namespace trace {
+
+enum Counter {
+    FilesOpened,
+    FileStats,
+    BytesRead,       // mapped files count their whole size
+    BytesWritten,    // including kernel-side copies
+    BytesHashed,
+    ObjectLookups,
+    COUNTER_COUNT
+};
+
+inline const char *counterName(Counter counter) {
+    static const char *names[COUNTER_COUNT] = {"files opened", "stat calls", "bytes read",
+                                               "bytes written", "bytes hashed", "object lookups"};
+    return names[counter];
+}
+
+struct Event {
+    const char *name;
+    int64_t startNs, endNs;
+    uint32_t thread;
+};
+
+inline std::atomic<bool> active{false};
+inline std::atomic<uint64_t> counters[COUNTER_COUNT];
+inline std::mutex eventMutex;
+inline std::vector<Event> events;
+inline std::chrono::steady_clock::time_point origin;
+
+inline bool enabled() { return active.load(std::memory_order_relaxed); }
+
+inline void count(Counter counter, uint64_t n = 1) {
+    if (enabled()) counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// Small per-thread IDs, in order of first use, for the trace viewer
+inline uint32_t threadId() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t id = next++;
+    return id;
+}
+
+inline void start() {
+    origin = std::chrono::steady_clock::now();
+    active.store(true, std::memory_order_relaxed);
+}
+
+// Times its own lifetime under `name`, which must be a string literal
+class Span {
+public:
+    explicit Span(const char *name) : name(enabled() ? name : nullptr) {
+        if (this->name) startNs = nowNs();
+    }
+
+    ~Span() {
+        if (!name) return;
+        Event event{name, startNs, nowNs(), threadId()};
+        std::lock_guard<std::mutex> lock(eventMutex);
+        events.push_back(event);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char *name;
+    int64_t startNs = 0;
+};
+
+// Calls, total and longest time per span name, slowest total first, then
+// the counters
+inline void writeSummary(std::ostream &out) {
+    struct Phase {
+        uint64_t calls = 0;
+        int64_t totalNs = 0, maxNs = 0;
+    };
+    std::map<std::string, Phase> phases;
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        for (const auto &event : events) {
+            Phase &phase = phases[event.name];
+            ++phase.calls;
+            phase.totalNs += event.endNs - event.startNs;
+            phase.maxNs = std::max(phase.maxNs, event.endNs - event.startNs);
+        }
+    }
+    std::vector<std::pair<std::string, Phase>> sorted(phases.begin(), phases.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto &a, const auto &b) { return a.second.totalNs > b.second.totalNs; });
+
+    out << "trace: " << std::fixed << std::setprecision(3) << nowNs() / 1e6 << " ms total\n";
+    out << std::left << std::setw(28) << "phase" << std::right << std::setw(8) << "calls" << std::setw(14) << "total ms"
+        << std::setw(14) << "max ms" << "\n";
+    for (const auto &[name, phase] : sorted) {
+        out << std::left << std::setw(28) << name << std::right << std::setw(8) << phase.calls << std::setw(14)
+            << phase.totalNs / 1e6 << std::setw(14) << phase.maxNs / 1e6 << "\n";
+    }
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        out << std::left << std::setw(28) << counterName(static_cast<Counter>(i)) << std::right << std::setw(22)
+            << counters[i].load() << "\n";
+    }
+}
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto): one complete event
+// per span and the counters as a final counter event
+inline void writeChromeTrace(std::ostream &out) {
+    int64_t endNs = nowNs();
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        for (const auto &event : events) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << event.thread << std::fixed << std::setprecision(3) << ",\"ts\":" << event.startNs / 1e3
+                << ",\"dur\":" << (event.endNs - event.startNs) / 1e3 << "}";
+            first = false;
+        }
+    }
+    out << (first ? "\n" : ",\n") << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << endNs / 1e3
+        << ",\"args\":{";
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        out << (i ? "," : "") << "\"" << counterName(static_cast<Counter>(i)) << "\":" << counters[i].load();
+    }
+    out << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+} // namespace trace
+
+#endif // TRACE_H
@@ -0,0 +1,230 @@
+// tree.h
+#ifndef TREE_H
+#define TREE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <string_view>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "objectstore.h"
+#include "index.h"
+#include "trace.h"
+
+// ---------------------
+// Tree objects
+// ---------------------
+// One tree object per directory, stored in the object store like a blob
+// and addressed by the SHA-1 of its text. Each line names one child:
+//
+//   blob <hash> <name>
+//   tree <hash> <name>
+//
+// sorted by name. A commit records only its root tree, so unchanged
+// subtrees are shared by hash between commits, and two trees with the same
+// hash can be skipped without reading them.
+struct TreeEntry {
+    std::string name;
+    std::string hash;
+    bool isTree = false;
+};
+
+namespace tree {
+
+inline std::string serialize(std::vector<TreeEntry> entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const TreeEntry &a, const TreeEntry &b) { return a.name < b.name; });
+    std::string out;
+    for (const auto &e : entries) out += (e.isTree ? "tree " : "blob ") + e.hash + " " + e.name + "\n";
+    return out;
+}
+
+// Recently parsed trees by hash. A hash always names the same tree, so
+// entries never go stale; the cache is simply dropped when it fills up.
+struct ParsedTreeCache {
+    static constexpr size_t MAX_TREES = 4096;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<TreeEntry>> trees;
+
+    static ParsedTreeCache &instance() {
+        static ParsedTreeCache cache;
+        return cache;
+    }
+};
+
+inline bool parse(std::string_view rest, std::vector<TreeEntry> &entries) {
+    while (!rest.empty()) {
+        size_t end = rest.find('\n');
+        std::string_view line = rest.substr(0, end);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+
+        // "<kind> <40-char hash> <name>"
+        if (line.size() < 47 || line[4] != ' ' || line[45] != ' ') return false;
+        entries.push_back({std::string(line.substr(46)), std::string(line.substr(5, 40)), line.substr(0, 4) == "tree"});
+    }
+    return true;
+}
+
+inline bool read(const ObjectStore &store, const std::string &hash, std::vector<TreeEntry> &entries) {
+    ParsedTreeCache &cache = ParsedTreeCache::instance();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.trees.find(hash);
+        if (it != cache.trees.end()) {
+            entries = it->second;
+            return true;
+        }
+    }
+
+    trace::Span span("tree.read");
+    entries.clear();
+    std::string content;
+    if (!store.readAll(hash, content) || !parse(content, entries)) return false;
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.trees.size() >= ParsedTreeCache::MAX_TREES) cache.trees.clear();
+    cache.trees.emplace(hash, entries);
+    return true;
+}
+
+inline std::string join(const std::string &dir, const std::string &name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+// A path component a tree can hold: an empty, "." or ".." name would make
+// the tree point outside itself, and an empty directory name would never
+// end the recursion below
+inline bool validName(const std::string &name) { return !name.empty() && name != "." && name != ".."; }
+
+// Builds and stores the tree for index entries [begin, end), which all lie
+// under `dir`. Directories whose tree is still cached in the index are not
+// visited at all. Returns "" on a write failure, or with `invalidPath` set
+// for an index path that can't be stored in a tree.
+template <typename It>
+std::string build(const ObjectStore &store, StagingIndex &index, const std::map<std::string, IndexEntry> &all,
+                  It begin, It end, const std::string &dir, std::string &invalidPath) {
+    std::string cached = index.cachedTree(dir);
+    if (!cached.empty()) return cached;
+
+    size_t prefixLength = dir.empty() ? 0 : dir.size() + 1;
+    std::vector<TreeEntry> entries;
+    for (It it = begin; it != end;) {
+        std::string rest = it->first.substr(prefixLength);
+        size_t slash = rest.find('/');
+        if (!validName(rest.substr(0, slash))) {
+            invalidPath = it->first;
+            return "";
+        }
+        if (slash == std::string::npos) {
+            entries.push_back({rest, it->second.hash, false});
+            ++it;
+            continue;
+        }
+
+        // Entries under "<sub>/" are contiguous; '0' sorts right after '/'
+        std::string name = rest.substr(0, slash);
+        std::string subdir = join(dir, name);
+        It subEnd = all.lower_bound(subdir + "0");
+        std::string hash = build(store, index, all, it, subEnd, subdir, invalidPath);
+        if (hash.empty()) return "";
+        entries.push_back({name, hash, true});
+        it = subEnd;
+    }
+
+    std::string hash = store.store(serialize(std::move(entries)));
+    if (!hash.empty()) index.cacheTree(dir, hash);
+    return hash;
+}
+
+} // namespace tree
+
+// Writes the trees for the whole index and returns the root tree hash, or
+// "" on a write failure or an invalid index path, which is then stored in
+// `invalidPath`. Cached trees are reused, so the cost follows the number of
+// directories changed since the last call, not the repo size.
+inline std::string writeTree(const ObjectStore &store, StagingIndex &index, std::string &invalidPath) {
+    const auto &all = index.all();
+    invalidPath.clear();
+    return tree::build(store, index, all, all.begin(), all.end(), "", invalidPath);
+}
+
+// (path, blob hash) pairs; kept sorted by path wherever it is returned
+using FileTable = std::vector<std::pair<std::string, std::string>>;
+
+// Appends every file under a tree to `files`, in tree order. Tree order
+// puts "a/b" before "a.txt", so callers wanting path order sort after.
+inline bool flattenTree(const ObjectStore &store, const std::string &treeHash, FileTable &files,
+                        const std::string &dir = "") {
+    std::vector<TreeEntry> entries;
+    if (!tree::read(store, treeHash, entries)) return false;
+    for (const auto &e : entries) {
+        std::string path = tree::join(dir, e.name);
+        if (!e.isTree) files.emplace_back(path, e.hash);
+        else if (!flattenTree(store, e.hash, files, path)) return false;
+    }
+    return true;
+}
+
+// Blob hash at `path` inside a tree, or "" if there is none. With
+// `treesToo`, a directory path yields its tree hash. Reads one tree per
+// path component.
+inline std::string lookupPath(const ObjectStore &store, std::string treeHash, const std::string &path,
+                              bool treesToo = false) {
+    size_t start = 0;
+    std::vector<TreeEntry> entries;
+    for (;;) {
+        size_t slash = path.find('/', start);
+        std::string name = path.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+        if (treeHash.empty() || !tree::read(store, treeHash, entries)) return "";
+
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const TreeEntry &e) { return e.name == name; });
+        if (it == entries.end()) return "";
+        if (slash == std::string::npos) return (it->isTree && !treesToo) ? "" : it->hash;
+        if (!it->isTree) return "";
+        treeHash = it->hash;
+        start = slash + 1;
+    }
+}
+
+// Calls fn(path, oldBlob, newBlob) for every path whose blob differs
+// between two trees, in tree order; a side without the path passes "".
+// Either tree hash may be "" for an empty tree. Both entry lists are
+// sorted by name, so each level is one merge pass, and subtrees with equal
+// hashes are skipped without being read.
+using TreeDiffFn = std::function<void(const std::string &, const std::string &, const std::string &)>;
+
+inline bool diffTrees(const ObjectStore &store, const std::string &oldTree, const std::string &newTree,
+                      const TreeDiffFn &fn, const std::string &dir = "") {
+    if (oldTree == newTree) return true;
+
+    std::vector<TreeEntry> oldEntries, newEntries;
+    if (!oldTree.empty() && !tree::read(store, oldTree, oldEntries)) return false;
+    if (!newTree.empty() && !tree::read(store, newTree, newEntries)) return false;
+
+    size_t i = 0, j = 0;
+    while (i < oldEntries.size() || j < newEntries.size()) {
+        const TreeEntry *before = i < oldEntries.size() ? &oldEntries[i] : nullptr;
+        const TreeEntry *after = j < newEntries.size() ? &newEntries[j] : nullptr;
+        int cmp = !before ? 1 : !after ? -1 : before->name.compare(after->name);
+        if (cmp < 0) after = nullptr;
+        if (cmp > 0) before = nullptr;
+        if (before) ++i;
+        if (after) ++j;
+
+        // A name can be a blob on one side and a tree on the other
+        std::string path = tree::join(dir, before ? before->name : after->name);
+        std::string oldBlob = before && !before->isTree ? before->hash : "";
+        std::string newBlob = after && !after->isTree ? after->hash : "";
+        if (oldBlob != newBlob) fn(path, oldBlob, newBlob);
+
+        std::string oldSub = before && before->isTree ? before->hash : "";
+        std::string newSub = after && after->isTree ? after->hash : "";
+        if (oldSub != newSub && !diffTrees(store, oldSub, newSub, fn, path)) return false;
+    }
+    return true;
+}
+
+#endif // TREE_H